@@ -0,0 +1,390 @@
+/*
+ * uparam 主机基准测试
+ * 在模拟分区上注册一组合成参数, 测量加载和保存的flash调用次数和耗时.
+ *
+ * gcc -O2 -DUPARAM_USING_POSIX -I. -no-pie uparam.c port/uparam_port_posix.c bench/uparam_bench.c -o uparam_bench
+ * ./uparam_bench [参数个数]
+ * 加 -DUPARAM_USING_LOG 测量日志模式
+ * 加 -DUPARAM_USING_ASYNC_FLUSH -lpthread 测量异步保存
+ * 加 -DUPARAM_USING_COMPRESS 测量压缩镜像, 和不压缩的结果对比 typical 的几行
+ * 每次保存后都打乱参数内存再重新加载, 读出的个数或内容和保存前不一样时返回1
+ */
+#include "uparam.h"
+#include <time.h>
+
+#define BENCH_PART_SIZE (256 * 1024)
+#define BENCH_LOOPS 200
+
+static uint8_t bench_data[64 * 1024];
+/* 往返检查用的保存前的参数内存 */
+static uint8_t bench_saved[sizeof(bench_data)];
+
+static void bench_default(void *address, uint16_t size)
+{
+    memset(address, 0x5A, size);
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* 按 1,2,4,8,16,... 字节混合生成参数表 */
+static param_define_struct *bench_make_list(uint32_t num)
+{
+    static const uint8_t sizes[] = {4, 4, 1, 2, 8, 4, 12, 32, 4, 64};
+    static const char *types[] = {"f", "d", "u", "u", "d", "vf", "vd", "vb", "u", "vw"};
+    param_define_struct *list = (param_define_struct *)calloc(num, sizeof(param_define_struct));
+    uint32_t offset = 0;
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        uint8_t size = sizes[i % sizeof(sizes)];
+        if (offset + size > sizeof(bench_data))
+        {
+            return RT_NULL;
+        }
+        list[i].address = bench_data + offset;
+        list[i].size = size;
+        char *name = (char *)malloc(20);
+        snprintf(name, 20, "bench.%u", i);
+        list[i].name = name;
+        list[i].type = types[i % sizeof(sizes)];
+        list[i].default_fun = bench_default;
+        offset += size;
+    }
+    return list;
+}
+
+/* 按类型填充接近实际的参数: 大部分为0, 重复的增益和标定值, 小整数, seed 改变其中一个值 */
+static void bench_fill_typical(param_define_struct *list, uint32_t num, uint32_t seed)
+{
+    for (uint32_t i = 0; i < num; i++)
+    {
+        uint8_t *p = (uint8_t *)list[i].address;
+        float f = (i % 7 == 0) ? 1.0f : (i % 5) * 0.25f;
+        int32_t d = (i % 3 == 0) ? 0 : (int32_t)(i % 50) - 25;
+
+        memset(p, 0, list[i].size);
+        switch (list[i].type[0])
+        {
+        case 'f':
+            memcpy(p, &f, sizeof(f));
+            break;
+        case 'd':
+            //小端符号扩展
+            memset(p, d < 0 ? 0xFF : 0, list[i].size);
+            memcpy(p, &d, list[i].size < 4 ? list[i].size : 4);
+            break;
+        case 'u':
+            p[0] = i % 4;
+            break;
+        case 'v':
+            //向量: 增益表全为1, 其它只有开头几个非0的标定值
+            if (list[i].type[1] == 'f')
+            {
+                f = 1.0f;
+                for (uint32_t k = 0; k + 4 <= list[i].size; k += 4)
+                {
+                    memcpy(p + k, &f, 4);
+                }
+            }
+            else
+            {
+                for (uint32_t k = 0; k < 4 && k < list[i].size; k++)
+                {
+                    p[k] = (uint8_t)(i + k);
+                }
+            }
+            break;
+        }
+    }
+    *(uint8_t *)list[num / 2].address = (uint8_t)seed;
+}
+
+static void bench_fail(const char *what, uint32_t cnt, uint32_t num)
+{
+    printf("round trip failed after %s: reload %d of %d params%s\n", what, cnt, num, (cnt == num) ? ", data differs" : "");
+    exit(1);
+}
+
+static void bench_load(uparam_part_t part, const char *name, void *buf, uint32_t buf_size, uint32_t num)
+{
+    uint32_t cnt;
+    double start;
+
+    uparam_set_read_buffer(buf, buf_size);
+    memcpy(bench_saved, bench_data, sizeof(bench_data));
+    uparam_posix_stat_reset(part);
+    start = now_us();
+    for (int i = 0; i < BENCH_LOOPS; i++)
+    {
+        if ((cnt = uparam_reload()) != num)
+        {
+            bench_fail(name, cnt, num);
+        }
+    }
+    printf("load %-12s buf %6d  read calls %6d  read bytes %8d  time %8.2f us\n", name, buf_size,
+           part->stat.read_calls / BENCH_LOOPS, part->stat.read_bytes / BENCH_LOOPS,
+           (now_us() - start) / BENCH_LOOPS);
+    if (memcmp(bench_saved, bench_data, sizeof(bench_data)))
+    {
+        bench_fail(name, num, num);
+    }
+}
+
+static uint32_t bench_image_data(param_define_struct *list, uint32_t num)
+{
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        size += list[i].size;
+    }
+    return size;
+}
+
+/* 记下保存后的参数内存, 打乱后重新加载, 读出的个数和内容都要和保存前一样 */
+static void bench_check(param_define_struct *list, uint32_t num, const char *what)
+{
+    uint32_t size = bench_image_data(list, num), cnt;
+
+    memcpy(bench_saved, bench_data, size);
+    memset(bench_data, 0xA5, size);
+    cnt = uparam_reload();
+    if (cnt != num || memcmp(bench_saved, bench_data, size))
+    {
+        bench_fail(what, cnt, num);
+    }
+}
+
+/* 只把同样长度的数据从分区读到内存, 作为加载耗时的下限 */
+static void bench_raw(uparam_part_t part, uint32_t size)
+{
+    static uint8_t raw[sizeof(bench_data)];
+    double start;
+
+    start = now_us();
+    for (int i = 0; i < BENCH_LOOPS; i++)
+    {
+        uparam_part_read(part, 0, raw, size);
+    }
+    printf("load %-12s %6s  read calls %6d  read bytes %8d  time %8.2f us\n", "raw read", "", 1, size,
+           (now_us() - start) / BENCH_LOOPS);
+}
+
+/* 保存, change: 0 不修改, 1 修改一个参数, 2 修改所有参数, 3 所有参数改为典型值(只有一个值每次不同) */
+static void bench_flush(uparam_part_t part, param_define_struct *list, uint32_t num, int change)
+{
+    static const char *names[] = {"unchanged", "one param", "all params", "typical"};
+    double start;
+
+    uparam_posix_stat_reset(part);
+    start = now_us();
+    for (int i = 0; i < BENCH_LOOPS; i++)
+    {
+        if (change == 1)
+        {
+            *(uint8_t *)list[num / 2].address = (uint8_t)i;
+            uparam_set_dirty(list[num / 2].address);
+        }
+        else if (change == 2)
+        {
+            memset(bench_data, i, sizeof(bench_data));
+            for (uint32_t k = 0; k < num; k++)
+            {
+                uparam_set_dirty(list[k].address);
+            }
+        }
+        else if (change == 3)
+        {
+            bench_fill_typical(list, num, i);
+            for (uint32_t k = 0; k < num; k++)
+            {
+                uparam_set_dirty(list[k].address);
+            }
+        }
+        uparam_flush();
+    }
+    printf("flush %-12s program ops %6d  write bytes %8d  pages %6d  erase sectors %4d  read bytes %8d  time %8.2f us\n",
+           names[change], part->stat.write_calls / BENCH_LOOPS, part->stat.write_bytes / BENCH_LOOPS,
+           part->stat.prog_pages / BENCH_LOOPS, part->stat.erase_sectors / BENCH_LOOPS,
+           part->stat.read_bytes / BENCH_LOOPS, (now_us() - start) / BENCH_LOOPS);
+    bench_check(list, num, names[change]);
+}
+
+/* 连续保存单个参数, 统计每个扇区的擦除次数 */
+static void bench_wear(uparam_part_t part, param_define_struct *list, uint32_t num, uint32_t saves)
+{
+    uint32_t sectors = part->len / part->sector_size;
+    uint32_t min = 0xFFFFFFFF, max = 0, total = 0;
+
+    memset(part->sector_erase, 0, sectors * sizeof(uint32_t));
+    for (uint32_t i = 0; i < saves; i++)
+    {
+        *(uint8_t *)list[i % num].address += 1;
+        uparam_set_dirty(list[i % num].address);
+        uparam_flush();
+    }
+    for (uint32_t s = 0; s < sectors; s++)
+    {
+        min = part->sector_erase[s] < min ? part->sector_erase[s] : min;
+        max = part->sector_erase[s] > max ? part->sector_erase[s] : max;
+        total += part->sector_erase[s];
+    }
+    printf("wear  %d single param saves, sectors %d, erase total %d min %d max %d\n", saves, sectors, total, min, max);
+    bench_check(list, num, "wear");
+}
+
+/* 按名称查找所有参数, 和逐个比较名称的线性查找对比 */
+static void bench_lookup(param_define_struct *list, uint32_t num)
+{
+    double start, linear;
+    uint32_t found = 0;
+
+    start = now_us();
+    for (uint32_t i = 0; i < num; i++)
+    {
+        for (uint32_t j = 0; j < num; j++)
+        {
+            if (!strcmp(list[j].name, list[i].name))
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    linear = (now_us() - start) * 1000 / num;
+
+    uparam_find(list[0].name);
+    start = now_us();
+    for (int loop = 0; loop < BENCH_LOOPS; loop++)
+    {
+        for (uint32_t i = 0; i < num; i++)
+        {
+            found += (uparam_find(list[i].name) == &list[i]);
+        }
+    }
+    printf("find  by name  %8.1f ns, linear scan %8.1f ns, found %d\n",
+           (now_us() - start) * 1000 / num / BENCH_LOOPS, linear, found);
+}
+
+/* 模拟控制循环每周期读12个参数, 比较直接读和按序号检查的读法, 没有定义 UPARAM_USING_LOCK 时两者相同 */
+static void bench_read(param_define_struct *list, uint32_t num, uint32_t cycles)
+{
+    volatile uint32_t sink = 0;
+    uint32_t n = (num < 12) ? num : 12;
+    double start, plain;
+    uint32_t seq, sum;
+
+    start = now_us();
+    for (uint32_t c = 0; c < cycles; c++)
+    {
+        sum = 0;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            sum += *(volatile uint8_t *)list[i].address;
+        }
+        sink += sum;
+    }
+    plain = (now_us() - start) * 1000 / cycles;
+
+    start = now_us();
+    for (uint32_t c = 0; c < cycles; c++)
+    {
+        do
+        {
+            seq = uparam_read_begin();
+            sum = 0;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                sum += *(volatile uint8_t *)list[i].address;
+            }
+        } while (uparam_read_retry(seq));
+        sink += sum;
+    }
+    printf("read  %d params plain %6.1f ns, seqlock %6.1f ns per cycle\n",
+           n, plain, (now_us() - start) * 1000 / cycles);
+}
+
+#ifdef UPARAM_USING_ASYNC_FLUSH
+/* 高频发出异步保存请求, 测量调用耗时和合并后实际的保存次数 */
+static void bench_async(uparam_part_t part, param_define_struct *list, uint32_t num, uint32_t requests)
+{
+    double start, call_us;
+
+    uparam_flush_wait(-1);
+    uparam_posix_stat_reset(part);
+    start = now_us();
+    for (uint32_t i = 0; i < requests; i++)
+    {
+        *(uint8_t *)list[i % num].address += 1;
+        uparam_set_dirty(list[i % num].address);
+        uparam_flush_async();
+    }
+    call_us = (now_us() - start) / requests;
+    start = now_us();
+    uparam_flush_wait(-1);
+    printf("async %d requests, call %.3f us, wait %.2f ms, program ops %d, erase sectors %d\n",
+           requests, call_us, (now_us() - start) / 1000, part->stat.write_calls, part->stat.erase_sectors);
+    bench_check(list, num, "async");
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    uint32_t num = (argc > 1) ? strtoul(argv[1], RT_NULL, 0) : 800;
+    static uint8_t big_buf[BENCH_PART_SIZE];
+    param_define_struct *list;
+    uparam_part_t part;
+
+    uparam_posix_log_level = LOG_LVL_ASSERT;
+    part = uparam_posix_part_add("param", RT_NULL, BENCH_PART_SIZE, 4096, 256);
+    uparam_posix_part_set_gran(part, UPARAM_WRITE_GRAN);
+    list = bench_make_list(num);
+    if (part == RT_NULL || list == RT_NULL)
+    {
+        printf("bench init failed\n");
+        return 1;
+    }
+    uparam_add_list(list, num);
+    uparam_init();
+
+    //逐条读取时每条记录一次flash读, 再加上头部
+    printf("params: %d, per-record loader read calls: %d\n", num, num + 1);
+    bench_load(part, "default", RT_NULL, UPARAM_READ_BUF_SIZE, num);
+    bench_load(part, "chunk 4K", big_buf, 4096, num);
+    bench_load(part, "whole image", big_buf, sizeof(big_buf), num);
+    bench_raw(part, part->stat.read_bytes / BENCH_LOOPS);
+
+    //逐条写入时每条记录一次编程, 再加上头部
+    printf("per-record writer program ops: %d\n", num + 1);
+    bench_flush(part, list, num, 0);
+    bench_flush(part, list, num, 1);
+    bench_flush(part, list, num, 2);
+
+    //典型参数的保存、加载和镜像大小
+    bench_flush(part, list, num, 3);
+    bench_flush(part, list, num, 1);
+    bench_load(part, "typical", RT_NULL, UPARAM_READ_BUF_SIZE, num);
+    bench_fill_typical(list, num, 0);
+    for (uint32_t k = 0; k < num; k++)
+    {
+        uparam_set_dirty(list[k].address);
+    }
+    uparam_flush();
+    uparam_posix_stat_reset(part);
+    uparam_reload();
+    printf("image typical size %d bytes, data %d bytes\n", part->stat.read_bytes, bench_image_data(list, num));
+    bench_check(list, num, "typical");
+    bench_wear(part, list, num, 5000);
+    bench_lookup(list, num);
+    bench_read(list, num, 1000000);
+#ifdef UPARAM_USING_ASYNC_FLUSH
+    bench_async(part, list, num, 100000);
+#endif
+
+    return 0;
+}
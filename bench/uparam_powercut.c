@@ -0,0 +1,179 @@
+/*
+ * uparam 日志模式掉电测试
+ * 在模拟分区上按固定顺序反复修改几个参数并保存, 每一次保存都从第0次编程/擦除开始, 逐个位置模拟掉电,
+ * 包括切换扇区时激活新扇区(log_activate)之后、回收最旧扇区的过程中. 每次掉电后重新加载, 检查:
+ *   1. 没有修改的参数是掉电前保存的值, 这次修改的参数是旧值或新值;
+ *   2. 从掉电后的状态继续保存, 经过几次切换扇区, 每次保存后重新加载, 所有参数都和内存里的一致.
+ *
+ * gcc -O2 -DUPARAM_USING_POSIX -DUPARAM_USING_LOG -I. -no-pie uparam.c port/uparam_port_posix.c bench/uparam_powercut.c -o uparam_powercut
+ * ./uparam_powercut
+ * 加 -DUPARAM_WRITE_GRAN=8 等选项检查对应的写入单位, 有错误时返回1
+ */
+#include "uparam.h"
+
+#ifndef UPARAM_USING_LOG
+#error "build with -DUPARAM_USING_LOG"
+#endif
+
+#define PC_SECTOR_SIZE 1024
+#define PC_SECTORS 4
+#define PC_PAGE_SIZE 256
+#define PC_NUM 24
+/* 只修改前一半参数, 后一半只在回收扇区时搬动 */
+#define PC_HOT 12
+#define PC_SIZE 16
+/* 每一步修改的参数个数 */
+#define PC_TOUCH 3
+/* 逐个掉电检查的保存次数, 覆盖几轮扇区回收 */
+#define PC_STEPS 96
+/* 掉电后继续保存的次数, 至少切换两次扇区 */
+#define PC_EXTRA 40
+
+static uint8_t pc_data[PC_NUM][PC_SIZE];
+static const uint8_t pc_zero[PC_SIZE];
+static param_define_struct pc_list[PC_NUM];
+static uint8_t pc_flash[PC_SECTORS * PC_SECTOR_SIZE];
+static uint8_t pc_base[PC_NUM][PC_SIZE];
+static uint8_t pc_new[PC_NUM][PC_SIZE];
+static uint8_t pc_expect[PC_NUM][PC_SIZE];
+static uint32_t pc_failed = 0;
+
+/* 第k步修改的第j个参数 */
+static uint32_t pc_index(uint32_t k, uint32_t j)
+{
+    return (k * 5 + j * 7) % PC_HOT;
+}
+
+static void pc_step(uint32_t k)
+{
+    for (uint32_t j = 0; j < PC_TOUCH; j++)
+    {
+        uint32_t n = pc_index(k, j);
+        for (uint32_t b = 0; b < PC_SIZE; b++)
+        {
+            pc_data[n][b] = (uint8_t)(k * PC_TOUCH + j + b * 29);
+        }
+        uparam_set_dirty(pc_data[n]);
+    }
+}
+
+static int pc_touched(uint32_t k, uint32_t n)
+{
+    for (uint32_t j = 0; j < PC_TOUCH; j++)
+    {
+        if (pc_index(k, j) == n)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pc_fail(uint32_t k, int32_t cut, const char *what, uint32_t n)
+{
+    if (pc_failed++ < 10)
+    {
+        printf("step %u cut %d: %s, param %u\n", k, cut, what, n);
+    }
+}
+
+int main(void)
+{
+    uint32_t cuts = 0;
+    uparam_part_t part;
+
+    uparam_posix_log_level = LOG_LVL_ASSERT;
+    part = uparam_posix_part_add("param", RT_NULL, sizeof(pc_flash), PC_SECTOR_SIZE, PC_PAGE_SIZE);
+    if (part == RT_NULL)
+    {
+        printf("partition init failed\n");
+        return 1;
+    }
+    uparam_posix_part_set_gran(part, UPARAM_WRITE_GRAN);
+    for (uint32_t n = 0; n < PC_NUM; n++)
+    {
+        char *name = (char *)malloc(16);
+        snprintf(name, 16, "pc.%u", n);
+        pc_list[n].address = pc_data[n];
+        pc_list[n].size = PC_SIZE;
+        pc_list[n].name = name;
+        pc_list[n].type = "vb";
+        pc_list[n].default_value = pc_zero;
+    }
+    uparam_add_list(pc_list, PC_NUM);
+    uparam_init();
+    for (uint32_t n = 0; n < PC_NUM; n++)
+    {
+        memset(pc_data[n], 0xA0 + n, PC_SIZE);
+        uparam_set_dirty(pc_data[n]);
+    }
+    uparam_flush();
+
+    for (uint32_t k = 0; k < PC_STEPS; k++)
+    {
+        memcpy(pc_flash, part->mem, sizeof(pc_flash));
+        memcpy(pc_base, pc_data, sizeof(pc_data));
+
+        for (int32_t cut = 0;; cut++)
+        {
+            int32_t left;
+
+            //回到这一步保存之前的状态
+            memcpy(part->mem, pc_flash, sizeof(pc_flash));
+            uparam_reload();
+            if (memcmp(pc_data, pc_base, sizeof(pc_data)))
+            {
+                pc_fail(k, cut, "restore mismatch", 0);
+                break;
+            }
+            pc_step(k);
+            memcpy(pc_new, pc_data, sizeof(pc_data));
+            uparam_posix_part_set_cut(part, cut);
+            uparam_flush();
+            left = part->cut;
+            uparam_posix_part_set_cut(part, -1);
+            cuts++;
+
+            uparam_reload();
+            for (uint32_t n = 0; n < PC_NUM; n++)
+            {
+                if (memcmp(pc_data[n], pc_base[n], PC_SIZE) &&
+                    !(pc_touched(k, n) && !memcmp(pc_data[n], pc_new[n], PC_SIZE)))
+                {
+                    pc_fail(k, cut, "lost after power cut", n);
+                }
+            }
+
+            //从掉电后的状态继续保存, 回收到掉电时的扇区, 每次保存后都重新加载检查
+            for (uint32_t m = k + 1; m <= k + PC_EXTRA; m++)
+            {
+                pc_step(m);
+                uparam_flush();
+                memcpy(pc_expect, pc_data, sizeof(pc_data));
+                memset(pc_data, 0, sizeof(pc_data));
+                uparam_reload();
+                for (uint32_t n = 0; n < PC_NUM; n++)
+                {
+                    if (memcmp(pc_data[n], pc_expect[n], PC_SIZE))
+                    {
+                        pc_fail(k, cut, "lost after more saves", n);
+                    }
+                }
+            }
+            //次数没用完, 这一步的保存已经完整执行
+            if (left != 0)
+            {
+                break;
+            }
+        }
+
+        //按不掉电的顺序执行这一步
+        memcpy(part->mem, pc_flash, sizeof(pc_flash));
+        uparam_reload();
+        pc_step(k);
+        uparam_flush();
+    }
+
+    printf("powercut steps %d, cuts %u, failed %u\n", PC_STEPS, cuts, pc_failed);
+    return pc_failed ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * uparam 主机基准测试套件
+ * 按不同的参数个数注册合成参数表(长度和类型混合, 固定种子生成, 每次运行一样), 在带耗时模型的模拟分区上测量
+ * 加载、保存、按序号查找和复位默认值, 每项输出墙钟时间、按模型计算的flash时间、调用次数、字节数和擦除次数,
+ * 格式为CSV或者每行一个JSON, 用于比较不同版本之间的差异.
+ *
+ * 要直接测量内部的 find_param_by_index、find_param_by_name 和 uparam_default, 这里把 uparam.c 包含进来编译, 不要再链接 uparam.c:
+ * gcc -O2 -DUPARAM_USING_POSIX -I. -no-pie port/uparam_port_posix.c bench/uparam_suite.c -o uparam_suite
+ * ./uparam_suite [-f csv|json] [-m nor|internal|none] [-t 读调用,读页,编程调用,编程页,擦除调用,擦除扇区(ns)] [参数个数 ...]
+ * 默认测量 10 100 1000 10000 个参数. uparam 只能初始化一次, 每个参数个数在单独的子进程里测量.
+ * 加 -DUPARAM_USING_LOG / -DUPARAM_USING_COMPRESS 等选项测量对应的模式.
+ * 每项保存后打乱参数内存再重新加载, 读出的个数或内容和保存前不一样时返回1.
+ */
+#include "../uparam.c"
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SUITE_SECTOR_SIZE 4096
+#define SUITE_PAGE_SIZE 256
+#define SUITE_LIST_MAX 500
+/* 结果格式的版本, 增减字段时修改 */
+#define SUITE_SCHEMA 1
+/* 存储格式, 日志模式没有镜像格式, 用格式版本号 */
+#ifdef IMAGE_FORMAT
+#define SUITE_FORMAT IMAGE_FORMAT
+#else
+#define SUITE_FORMAT UPARAM_FORMAT_VERSION
+#endif
+
+/* flash耗时模型, 取自常见器件数据手册的典型值 */
+static const struct
+{
+    const char *name;
+    struct uparam_posix_timing timing;
+} suite_models[] = {
+    /* SPI NOR (W25Q 类): 50MHz 四线读, 页编程 0.7ms, 4KB 扇区擦除 45ms */
+    {"nor", {2000, 10000, 2000, 700000, 2000, 45000000}},
+    /* MCU 内部flash (STM32L4 类): 总线读, 双字编程约 90us/页, 2KB 页擦除 22ms, 按4KB扇区计 */
+    {"internal", {100, 2000, 1000, 90000, 1000, 44000000}},
+    {"none", {0, 0, 0, 0, 0, 0}},
+};
+
+static struct uparam_posix_timing suite_timing;
+static const char *suite_model = "nor";
+static int suite_json = 0;
+
+static double suite_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* 固定种子的线性同余随机数, 保证每次生成的参数表一样 */
+static uint32_t suite_seed = 1;
+static uint32_t suite_rand(void)
+{
+    suite_seed = suite_seed * 1103515245u + 12345u;
+    return suite_seed >> 8;
+}
+
+static void suite_default(void *address, uint16_t size)
+{
+    memset(address, 0x5A, size);
+}
+
+/**
+  * @brief  suite_make_lists
+  * @note   生成num个参数, 每个参数表最多 SUITE_LIST_MAX 个. 偶数序号用默认值, 奇数用默认值函数
+  * @retval 参数数据总长度
+  */
+static uint32_t suite_make_lists(uint32_t num)
+{
+    static const struct
+    {
+        const char *type;
+        uint16_t size;
+    } kinds[] = {{"u", 1}, {"u", 2}, {"u", 4}, {"d", 4}, {"d", 8}, {"f", 4}, {"f", 8},
+                 {"s", 16}, {"s", 32}, {"vb", 8}, {"vb", 64}, {"vw", 16}, {"vd", 32}, {"vf", 12}, {"vf", 64}};
+    uint32_t total = 0;
+
+    suite_seed = 1;
+    for (uint32_t base = 0; base < num; base += SUITE_LIST_MAX)
+    {
+        uint32_t n = (num - base < SUITE_LIST_MAX) ? num - base : SUITE_LIST_MAX;
+        param_define_struct *list = (param_define_struct *)calloc(n, sizeof(param_define_struct));
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t k = suite_rand() % (sizeof(kinds) / sizeof(kinds[0]));
+            char *name = (char *)malloc(24);
+            uint8_t *def;
+
+            snprintf(name, 24, "suite.%u", base + i);
+            list[i].address = calloc(1, kinds[k].size);
+            list[i].size = kinds[k].size;
+            list[i].name = name;
+            list[i].type = kinds[k].type;
+            if (i % 2 == 0)
+            {
+                def = (uint8_t *)malloc(kinds[k].size);
+                for (uint16_t b = 0; b < kinds[k].size; b++)
+                {
+                    def[b] = (uint8_t)suite_rand();
+                }
+                list[i].default_value = def;
+            }
+            else
+            {
+                list[i].default_fun = suite_default;
+            }
+            total += kinds[k].size;
+        }
+        uparam_add_list(list, n);
+    }
+    return total;
+}
+
+/**
+  * @brief  suite_report
+  * @note   输出一项结果, 分区统计是loops次的平均值
+  * @retval None
+  */
+static void suite_report(uparam_part_t part, uint32_t num, const char *op, uint32_t loops, double wall_us)
+{
+    struct uparam_posix_stat *st = &part->stat;
+    double flash_us = st->flash_ns / 1e3 / loops;
+
+    if (suite_json)
+    {
+        printf("{\"schema\":%d,\"format\":%d,\"model\":\"%s\",\"params\":%u,\"op\":\"%s\",\"loops\":%u,"
+               "\"wall_us\":%.3f,\"flash_us\":%.3f,\"read_calls\":%.1f,\"read_bytes\":%.1f,\"prog_calls\":%.1f,"
+               "\"prog_bytes\":%.1f,\"prog_pages\":%.1f,\"erase_calls\":%.1f,\"erase_sectors\":%.1f}\n",
+               SUITE_SCHEMA, SUITE_FORMAT, suite_model, num, op, loops, wall_us / loops, flash_us,
+               (double)st->read_calls / loops, (double)st->read_bytes / loops, (double)st->write_calls / loops,
+               (double)st->write_bytes / loops, (double)st->prog_pages / loops, (double)st->erase_calls / loops,
+               (double)st->erase_sectors / loops);
+    }
+    else
+    {
+        printf("%d,%d,%s,%u,%s,%u,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", SUITE_SCHEMA, SUITE_FORMAT,
+               suite_model, num, op, loops, wall_us / loops, flash_us, (double)st->read_calls / loops,
+               (double)st->read_bytes / loops, (double)st->write_calls / loops, (double)st->write_bytes / loops,
+               (double)st->prog_pages / loops, (double)st->erase_calls / loops, (double)st->erase_sectors / loops);
+    }
+}
+
+/* 把所有参数的内存依次复制到buf, restore为1时反过来从buf写回参数 */
+static void suite_copy(uint8_t *buf, uint32_t num, int restore)
+{
+    for (uint32_t n = 0; n < num; n++)
+    {
+        param_list *pa = find_param_by_index(n);
+
+        if (restore)
+        {
+            memcpy(pa->address, buf, pa->size);
+        }
+        else
+        {
+            memcpy(buf, pa->address, pa->size);
+        }
+        buf += pa->size;
+    }
+}
+
+static void suite_fail(const char *op, uint32_t cnt, uint32_t num)
+{
+    printf("round trip failed after %s: reload %u of %u params%s\n", op, cnt, num, (cnt == num) ? ", data differs" : "");
+    fflush(stdout);
+    _exit(1);
+}
+
+/**
+  * @brief  suite_check
+  * @note   往返检查: 记下保存后的参数内存, 打乱后重新加载, 读出的个数和内容都要和保存前一样, 否则退出
+  * @param  *saved: 参数内存的快照
+  * @param  *scratch: 同样大小的临时缓冲
+  * @param  data: 参数数据总长度
+  * @retval None
+  */
+static void suite_check(uint8_t *saved, uint8_t *scratch, uint32_t num, uint32_t data, const char *op)
+{
+    uint32_t cnt;
+
+    suite_copy(saved, num, 0);
+    memset(scratch, 0xA5, data);
+    suite_copy(scratch, num, 1);
+    cnt = uparam_reload();
+    suite_copy(scratch, num, 0);
+    if (cnt != num || memcmp(saved, scratch, data))
+    {
+        suite_fail(op, cnt, num);
+    }
+}
+
+/* 修改第n个参数并标记 */
+static void suite_touch(uint32_t n, uint32_t seed)
+{
+    param_list *pa = find_param_by_index(n);
+
+    *(uint8_t *)pa->address = (uint8_t)(seed + n);
+    uparam_set_dirty(pa->address);
+}
+
+/**
+  * @brief  suite_run
+  * @note   测量一个参数个数, 在子进程里执行
+  * @retval None
+  */
+static void suite_run(uint32_t num)
+{
+    uint32_t data = 0, part_size, loops, cnt;
+    volatile uintptr_t sink = 0;
+    uint8_t *saved, *scratch;
+    uparam_part_t part;
+    double start, wall;
+
+    uparam_posix_log_level = LOG_LVL_ASSERT;
+    data = suite_make_lists(num);
+    //数据、目录和头部的两倍, 日志模式至少3个扇区, 再多留几个扇区
+    part_size = UPARAM_ALIGN((data + num * (sizeof(param_p) + 1)) * 2, SUITE_SECTOR_SIZE) + 4 * SUITE_SECTOR_SIZE;
+    part = uparam_posix_part_add("param", RT_NULL, part_size, SUITE_SECTOR_SIZE, SUITE_PAGE_SIZE);
+    if (part == RT_NULL)
+    {
+        printf("partition init failed, size: %u\n", part_size);
+        return;
+    }
+    uparam_posix_part_set_gran(part, UPARAM_WRITE_GRAN);
+    uparam_posix_part_set_timing(part, &suite_timing);
+    uparam_init();
+    saved = (uint8_t *)malloc(data);
+    scratch = (uint8_t *)malloc(data);
+    //次数随参数个数减少, 总耗时大致相同
+    loops = 20000 / num;
+    loops = (loops < 3) ? 3 : (loops > 200) ? 200 : loops;
+
+    suite_copy(saved, num, 0);
+    uparam_posix_stat_reset(part);
+    start = suite_now_us();
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        if ((cnt = uparam_reload()) != num)
+        {
+            suite_fail("load", cnt, num);
+        }
+    }
+    suite_report(part, num, "load", loops, suite_now_us() - start);
+    suite_copy(scratch, num, 0);
+    if (memcmp(saved, scratch, data))
+    {
+        suite_fail("load", num, num);
+    }
+
+    uparam_posix_stat_reset(part);
+    start = suite_now_us();
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        uparam_flush();
+    }
+    suite_report(part, num, "flush_none", loops, suite_now_us() - start);
+    suite_check(saved, scratch, num, data, "flush_none");
+
+    uparam_posix_stat_reset(part);
+    wall = 0;
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        suite_touch(num / 2, i);
+        start = suite_now_us();
+        uparam_flush();
+        wall += suite_now_us() - start;
+    }
+    suite_report(part, num, "flush_one", loops, wall);
+    suite_check(saved, scratch, num, data, "flush_one");
+
+    uparam_posix_stat_reset(part);
+    wall = 0;
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        for (uint32_t n = 0; n < num; n++)
+        {
+            suite_touch(n, i);
+        }
+        start = suite_now_us();
+        uparam_flush();
+        wall += suite_now_us() - start;
+    }
+    suite_report(part, num, "flush_all", loops, wall);
+    suite_check(saved, scratch, num, data, "flush_all");
+
+    //按序号和名字查找, 每次查找所有参数, 结果是一轮的时间. 按名字查找包含一次按序号查找
+    uparam_posix_stat_reset(part);
+    start = suite_now_us();
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        for (uint32_t n = 0; n < num; n++)
+        {
+            sink += (uintptr_t)find_param_by_index((n * 7919u + i) % num);
+        }
+    }
+    suite_report(part, num, "lookup_index", loops, suite_now_us() - start);
+
+    uparam_posix_stat_reset(part);
+    start = suite_now_us();
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        for (uint32_t n = 0; n < num; n++)
+        {
+            sink += (uintptr_t)find_param_by_name(find_param_by_index((n * 7919u + i) % num)->name);
+        }
+    }
+    suite_report(part, num, "lookup_name", loops, suite_now_us() - start);
+
+    uparam_posix_stat_reset(part);
+    wall = 0;
+    for (uint32_t i = 0; i < loops; i++)
+    {
+        for (uint32_t li = 0; li < param_index; li++)
+        {
+            memset(ls[li].read_valid, 0, UPARAM_BIT_BYTES(ls[li].par_list_size));
+        }
+        start = suite_now_us();
+        uparam_default();
+        wall += suite_now_us() - start;
+    }
+    suite_report(part, num, "default", loops, wall);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t default_counts[] = {10, 100, 1000, 10000};
+    int opt, status, failed = 0;
+
+    suite_timing = suite_models[0].timing;
+    while ((opt = getopt(argc, argv, "f:m:t:")) != -1)
+    {
+        if (opt == 'f')
+        {
+            suite_json = !strcmp(optarg, "json");
+        }
+        else if (opt == 'm')
+        {
+            uint32_t m;
+            for (m = 0; m < sizeof(suite_models) / sizeof(suite_models[0]) && strcmp(suite_models[m].name, optarg); m++)
+            {
+            }
+            if (m == sizeof(suite_models) / sizeof(suite_models[0]))
+            {
+                printf("unknown model %s\n", optarg);
+                return 2;
+            }
+            suite_model = suite_models[m].name;
+            suite_timing = suite_models[m].timing;
+        }
+        else if (opt == 't')
+        {
+            struct uparam_posix_timing *t = &suite_timing;
+            if (sscanf(optarg, "%u,%u,%u,%u,%u,%u", &t->read_call, &t->read_page, &t->prog_call, &t->prog_page,
+                       &t->erase_call, &t->erase_sector) != 6)
+            {
+                printf("timing: read_call,read_page,prog_call,prog_page,erase_call,erase_sector in ns\n");
+                return 2;
+            }
+            suite_model = "custom";
+        }
+        else
+        {
+            return 2;
+        }
+    }
+
+    if (!suite_json)
+    {
+        printf("schema,format,model,params,op,loops,wall_us,flash_us,read_calls,read_bytes,prog_calls,prog_bytes,"
+               "prog_pages,erase_calls,erase_sectors\n");
+    }
+    for (int i = 0; i < ((optind < argc) ? argc - optind : 4); i++)
+    {
+        uint32_t num = (optind < argc) ? strtoul(argv[optind + i], RT_NULL, 0) : default_counts[i];
+        pid_t pid;
+
+        if (num == 0)
+        {
+            continue;
+        }
+        fflush(stdout);
+        if ((pid = fork()) == 0)
+        {
+            suite_run(num);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, &status, 0);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    return failed;
+}
@@ -0,0 +1,423 @@
+#include "uparam_port_posix.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
+
+#define UPARAM_POSIX_PART_MAX 8
+
+int uparam_posix_log_level = LOG_LVL_WARNING;
+
+static struct uparam_posix_part part_table[UPARAM_POSIX_PART_MAX];
+static int part_num = 0;
+
+/**
+  * @brief  uparam_posix_part_add
+  * @note   添加一个模拟分区, 文件不存在或者长度不对时创建并擦除为0xFF
+  * @param  *name: 分区名
+  * @param  *path: 文件路径, RT_NULL为匿名内存
+  * @param  len: 分区长度, 必须是扇区大小的整数倍
+  * @param  sector_size: 擦除扇区大小
+  * @param  page_size: 编程页大小
+  * @retval 分区, 失败返回RT_NULL
+  */
+uparam_part_t uparam_posix_part_add(const char *name, const char *path, uint32_t len,
+                                    uint32_t sector_size, uint32_t page_size)
+{
+    struct uparam_posix_part *part;
+    int fresh = 1;
+
+    if (part_num >= UPARAM_POSIX_PART_MAX || sector_size == 0 || page_size == 0 || len % sector_size != 0)
+    {
+        return RT_NULL;
+    }
+    part = &part_table[part_num];
+    memset(part, 0, sizeof(struct uparam_posix_part));
+    strncpy(part->name, name, sizeof(part->name) - 1);
+    part->len = len;
+    part->sector_size = sector_size;
+    part->page_size = page_size;
+    part->write_gran = 1;
+    part->overwrite = 1;
+    part->cut = -1;
+    part->fd = -1;
+
+    if (path != RT_NULL)
+    {
+        struct stat st;
+
+        part->fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (part->fd < 0)
+        {
+            return RT_NULL;
+        }
+        if (fstat(part->fd, &st) == 0 && st.st_size == len)
+        {
+            fresh = 0;
+        }
+        else if (ftruncate(part->fd, len) != 0)
+        {
+            close(part->fd);
+            return RT_NULL;
+        }
+        part->mem = mmap(RT_NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, part->fd, 0);
+    }
+    else
+    {
+        part->mem = mmap(RT_NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (part->mem == MAP_FAILED)
+    {
+        if (part->fd >= 0)
+        {
+            close(part->fd);
+        }
+        return RT_NULL;
+    }
+    if (fresh)
+    {
+        memset(part->mem, 0xFF, len);
+    }
+    part->sector_erase = (uint32_t *)calloc(len / sector_size, sizeof(uint32_t));
+    part_num++;
+
+    return part;
+}
+
+/**
+  * @brief  uparam_posix_part_set_gran
+  * @note   设置最小写入单位, 模拟STM32L4/H7等内部flash的8/16/32字节编程粒度
+  * @retval None
+  */
+void uparam_posix_part_set_gran(uparam_part_t part, uint32_t write_gran)
+{
+    part->write_gran = write_gran ? write_gran : 1;
+}
+
+/**
+  * @brief  uparam_posix_part_set_overwrite
+  * @note   设置能否在已编程的位置再编程. 不能时写入的每个写入单位都必须是擦除后的0xFF, 否则写入失败
+  * @retval None
+  */
+void uparam_posix_part_set_overwrite(uparam_part_t part, int overwrite)
+{
+    part->overwrite = overwrite;
+}
+
+/**
+  * @brief  uparam_posix_part_set_cut
+  * @note   模拟掉电, 再执行ops次编程或擦除后, 之后的编程和擦除都不改变分区内容并返回失败.
+  *         用来检查写入过程中任意位置掉电后重新加载的结果
+  * @param  ops: 还能执行的次数, 小于0时恢复正常
+  * @retval None
+  */
+void uparam_posix_part_set_cut(uparam_part_t part, int32_t ops)
+{
+    part->cut = ops;
+}
+
+/**
+  * @brief  uparam_posix_part_set_timing
+  * @note   设置flash耗时模型, 之后的读写擦按模型累计到 stat.flash_ns, 不会真的等待
+  * @retval None
+  */
+void uparam_posix_part_set_timing(uparam_part_t part, const struct uparam_posix_timing *timing)
+{
+    part->timing = *timing;
+}
+
+/* 一次访问跨过的页数 */
+static uint32_t part_pages(uparam_part_t part, uint32_t addr, size_t size)
+{
+    return (size > 0) ? (addr + size - 1) / part->page_size - addr / part->page_size + 1 : 0;
+}
+
+void uparam_posix_stat_reset(uparam_part_t part)
+{
+    memset(&part->stat, 0, sizeof(part->stat));
+}
+
+void uparam_posix_part_remove_all(void)
+{
+    for (int i = 0; i < part_num; i++)
+    {
+        munmap(part_table[i].mem, part_table[i].len);
+        if (part_table[i].fd >= 0)
+        {
+            close(part_table[i].fd);
+        }
+        free(part_table[i].sector_erase);
+    }
+    part_num = 0;
+}
+
+uparam_part_t uparam_part_find(const char *name)
+{
+    for (int i = 0; i < part_num; i++)
+    {
+        if (!strcmp(part_table[i].name, name))
+        {
+            return &part_table[i];
+        }
+    }
+    return RT_NULL;
+}
+
+int uparam_part_read(uparam_part_t part, uint32_t addr, uint8_t *buf, size_t size)
+{
+    if (addr + size > part->len)
+    {
+        return -1;
+    }
+    memcpy(buf, part->mem + addr, size);
+    part->stat.read_calls++;
+    part->stat.read_bytes += size;
+    part->stat.flash_ns += part->timing.read_call + (uint64_t)part->timing.read_page * part_pages(part, addr, size);
+
+    return size;
+}
+
+/* 模拟掉电, 一次操作要编程的页数或擦除的扇区数为units, 返回掉电前能完成的个数 */
+static uint32_t part_power(uparam_part_t part, uint32_t units)
+{
+    if (part->cut < 0)
+    {
+        return units;
+    }
+    if ((uint32_t)part->cut < units)
+    {
+        units = part->cut;
+    }
+    part->cut -= units;
+    return units;
+}
+
+int uparam_part_write(uparam_part_t part, uint32_t addr, const uint8_t *buf, size_t size)
+{
+    uint32_t pages = part_pages(part, addr, size);
+    size_t done = size;
+
+    if (addr + size > part->len)
+    {
+        return -1;
+    }
+    if (addr % part->write_gran != 0 || size % part->write_gran != 0)
+    {
+        printf("[posix] unaligned write, addr: 0x%X, size: %d, gran: %d\n", addr, (int)size, part->write_gran);
+        return -1;
+    }
+    //带ECC的flash只能写擦除后没写过的单位
+    for (size_t i = 0; i < size && !part->overwrite; i += part->write_gran)
+    {
+        for (uint32_t k = 0; k < part->write_gran; k++)
+        {
+            if (part->mem[addr + i + k] != 0xFF)
+            {
+                printf("[posix] program over written data, addr: 0x%X\n", (unsigned)(addr + i));
+                return -1;
+            }
+        }
+    }
+    //掉电时只编程完前面的页
+    pages = part_power(part, pages);
+    if (pages < part_pages(part, addr, size))
+    {
+        done = (pages == 0) ? 0 : (addr / part->page_size + pages) * part->page_size - addr;
+    }
+    //编程只能把1写成0
+    for (size_t i = 0; i < done; i++)
+    {
+        part->mem[addr + i] &= buf[i];
+    }
+    part->stat.write_calls++;
+    part->stat.write_bytes += done;
+    part->stat.prog_pages += pages;
+    part->stat.flash_ns += part->timing.prog_call + (uint64_t)part->timing.prog_page * pages;
+
+    return (done == size) ? (int)size : -1;
+}
+
+int uparam_part_erase(uparam_part_t part, uint32_t addr, size_t size)
+{
+    uint32_t start, end, sectors;
+
+    if (addr + size > part->len)
+    {
+        return -1;
+    }
+    //按扇区擦除, 覆盖到的扇区都会被擦掉, 掉电时只擦除完前面的扇区
+    start = addr / part->sector_size;
+    end = (addr + size + part->sector_size - 1) / part->sector_size;
+    sectors = part_power(part, end - start);
+    for (uint32_t s = start; s < start + sectors; s++)
+    {
+        memset(part->mem + s * part->sector_size, 0xFF, part->sector_size);
+        part->sector_erase[s]++;
+        part->stat.erase_sectors++;
+    }
+    part->stat.erase_calls++;
+    part->stat.flash_ns += part->timing.erase_call + (uint64_t)part->timing.erase_sector * sectors;
+
+    return (start + sectors == end) ? (int)size : -1;
+}
+
+struct uparam_posix_sem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t value;
+};
+
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uparam_sem_t uparam_sem_create(const char *name)
+{
+    struct uparam_posix_sem *sem = (struct uparam_posix_sem *)calloc(1, sizeof(struct uparam_posix_sem));
+
+    (void)name;
+    if (sem != RT_NULL)
+    {
+        pthread_mutex_init(&sem->lock, RT_NULL);
+        pthread_cond_init(&sem->cond, RT_NULL);
+    }
+    return sem;
+}
+
+rt_err_t uparam_sem_take(uparam_sem_t sem, int32_t ms)
+{
+    struct timespec ts;
+    rt_err_t result = RT_EOK;
+
+    if (ms >= 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&sem->lock);
+    while (sem->value == 0)
+    {
+        if (ms < 0)
+        {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        }
+        else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &ts) == ETIMEDOUT)
+        {
+            result = -RT_ETIMEOUT;
+            break;
+        }
+    }
+    if (result == RT_EOK)
+    {
+        sem->value--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return result;
+}
+
+void uparam_sem_release(uparam_sem_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    sem->value++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+}
+
+/* 和 RT-Thread 的互斥锁一样可以在同一线程里嵌套加锁 */
+uparam_mutex_t uparam_mutex_create(const char *name)
+{
+    pthread_mutex_t *mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+    pthread_mutexattr_t attr;
+
+    (void)name;
+    if (mutex != RT_NULL)
+    {
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    return mutex;
+}
+
+rt_base_t uparam_irq_lock(void)
+{
+    pthread_mutex_lock(&irq_lock);
+    return 0;
+}
+
+void uparam_irq_unlock(rt_base_t level)
+{
+    (void)level;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+void uparam_delay_ms(int32_t ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+uint32_t uparam_posix_clock_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+/* 线程入口和参数, 由 posix_thread_entry 释放 */
+struct posix_thread_arg
+{
+    void (*entry)(void *param);
+    void *param;
+};
+
+/* pthread的入口函数类型不同, 不能直接转换函数指针调用 */
+static void *posix_thread_entry(void *arg)
+{
+    struct posix_thread_arg a = *(struct posix_thread_arg *)arg;
+
+    free(arg);
+    a.entry(a.param);
+    return RT_NULL;
+}
+
+/* 主机上忽略栈大小和优先级 */
+rt_err_t uparam_thread_start(const char *name, void (*entry)(void *param), void *param,
+                             uint32_t stack_size, uint8_t priority)
+{
+    struct posix_thread_arg *arg = (struct posix_thread_arg *)malloc(sizeof(struct posix_thread_arg));
+    pthread_t tid;
+
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    if (arg == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    arg->entry = entry;
+    arg->param = param;
+    if (pthread_create(&tid, RT_NULL, posix_thread_entry, arg) != 0)
+    {
+        free(arg);
+        return -RT_ERROR;
+    }
+    pthread_detach(tid);
+
+    return RT_EOK;
+}
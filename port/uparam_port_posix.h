@@ -0,0 +1,168 @@
+#ifndef UPARAM_PORT_POSIX_H
+#define UPARAM_PORT_POSIX_H
+
+/*
+ * uparam POSIX(Linux) 移植
+ * 参数分区由一个 mmap 的文件模拟, 扇区/页大小可配置, 擦除后为0xFF,
+ * 写入只能把bit从1写成0(与NOR flash一致). 分区会统计读写擦的调用次数和字节数,
+ * 用于在主机上测量加载和保存的开销.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+/* RT-Thread 兼容定义, 只包含 uparam 用到的部分 */
+typedef long rt_err_t;
+typedef long rt_base_t;
+typedef unsigned long rt_ubase_t;
+
+#define RT_EOK 0
+#define RT_ERROR 1
+#define RT_ETIMEOUT 2
+#define RT_EINVAL 10
+#define RT_NULL ((void *)0)
+
+#define RT_ASSERT(ex) assert(ex)
+#define rt_kprintf printf
+
+/* 日志 */
+#define LOG_LVL_ASSERT 0
+#define LOG_LVL_ERROR 3
+#define LOG_LVL_WARNING 4
+#define LOG_LVL_INFO 6
+#define LOG_LVL_DBG 7
+
+#ifndef LOG_D
+#define UPARAM_POSIX_LOG(lvl, tag, ...)                          \
+    do                                                           \
+    {                                                            \
+        if ((lvl) <= LOG_LVL && (lvl) <= uparam_posix_log_level) \
+        {                                                        \
+            printf("[%s] ", tag);                                \
+            printf(__VA_ARGS__);                                 \
+            printf("\n");                                        \
+        }                                                        \
+    } while (0)
+
+#define LOG_D(...) UPARAM_POSIX_LOG(LOG_LVL_DBG, LOG_TAG, __VA_ARGS__)
+#define LOG_I(...) UPARAM_POSIX_LOG(LOG_LVL_INFO, LOG_TAG, __VA_ARGS__)
+#define LOG_W(...) UPARAM_POSIX_LOG(LOG_LVL_WARNING, LOG_TAG, __VA_ARGS__)
+#define LOG_E(...) UPARAM_POSIX_LOG(LOG_LVL_ERROR, LOG_TAG, __VA_ARGS__)
+#endif
+
+/* 运行时日志等级, 默认只输出警告和错误, 测量时避免日志干扰 */
+extern int uparam_posix_log_level;
+
+/* 内存分配 */
+#define UPARAM_MALLOC(size) malloc(size)
+#define UPARAM_REALLOC(ptr, size) realloc(ptr, size)
+#define UPARAM_FREE(ptr) free(ptr)
+
+/* 主机上没有自动初始化, 由应用主动调用 uparam_init() */
+#define UPARAM_INIT_EXPORT(fn)
+/* shell命令导出为 uparam_posix_cmd_xxx(argc, argv) */
+#define UPARAM_CMD_EXPORT(cmd, desc)                      \
+    void uparam_posix_cmd_##cmd(int argc, char **argv); \
+    void uparam_posix_cmd_##cmd(int argc, char **argv) { cmd(argc, argv); }
+
+void uparam_posix_cmd_par(int argc, char **argv);
+
+/* 分区操作统计 */
+struct uparam_posix_stat
+{
+    uint32_t read_calls;
+    uint32_t read_bytes;
+    uint32_t write_calls;
+    uint32_t write_bytes;
+    /* 按页计算的编程次数, 一次写跨几页就算几次 */
+    uint32_t prog_pages;
+    uint32_t erase_calls;
+    uint32_t erase_sectors;
+    /* 按耗时模型累计的flash时间, 纳秒 */
+    uint64_t flash_ns;
+};
+
+/* flash耗时模型, 单位纳秒, 每次调用的固定开销加上按页(擦除按扇区)计算的部分, 全为0时不计 */
+struct uparam_posix_timing
+{
+    uint32_t read_call;
+    uint32_t read_page;
+    uint32_t prog_call;
+    uint32_t prog_page;
+    uint32_t erase_call;
+    uint32_t erase_sector;
+};
+
+/* 模拟的参数分区 */
+struct uparam_posix_part
+{
+    char name[24];
+    uint8_t *mem;
+    uint32_t len;
+    uint32_t sector_size;
+    uint32_t page_size;
+    /* 最小写入单位, 地址和长度都必须对齐 */
+    uint32_t write_gran;
+    /* 能否在已编程的位置再编程, 默认可以(NOR flash), 为0时模拟带ECC的flash, 只能写擦除后没写过的单位 */
+    int overwrite;
+    /* 模拟掉电: 还能执行的编程和擦除次数, 用完后都失败, 小于0时不限制 */
+    int32_t cut;
+    int fd;
+
+    struct uparam_posix_stat stat;
+    struct uparam_posix_timing timing;
+    /* 每个扇区的累计擦除次数 */
+    uint32_t *sector_erase;
+};
+
+typedef struct uparam_posix_part *uparam_part_t;
+
+/* 创建(或打开已有的)文件作为分区, path为空时使用匿名内存 */
+uparam_part_t uparam_posix_part_add(const char *name, const char *path, uint32_t len,
+                                    uint32_t sector_size, uint32_t page_size);
+/* 设置最小写入单位 */
+void uparam_posix_part_set_gran(uparam_part_t part, uint32_t write_gran);
+/* 设置能否在已编程的位置再编程 */
+void uparam_posix_part_set_overwrite(uparam_part_t part, int overwrite);
+/* 模拟掉电, 再执行ops次编程或擦除后都失败, ops小于0时恢复 */
+void uparam_posix_part_set_cut(uparam_part_t part, int32_t ops);
+/* 设置flash耗时模型 */
+void uparam_posix_part_set_timing(uparam_part_t part, const struct uparam_posix_timing *timing);
+/* 清零统计 */
+void uparam_posix_stat_reset(uparam_part_t part);
+/* 释放所有分区 */
+void uparam_posix_part_remove_all(void);
+
+uparam_part_t uparam_part_find(const char *name);
+int uparam_part_read(uparam_part_t part, uint32_t addr, uint8_t *buf, size_t size);
+int uparam_part_write(uparam_part_t part, uint32_t addr, const uint8_t *buf, size_t size);
+int uparam_part_erase(uparam_part_t part, uint32_t addr, size_t size);
+#define uparam_part_sector_size(part) ((part)->sector_size)
+#define uparam_part_overwrite(part) ((part)->overwrite)
+
+/* 线程和同步, 用pthread实现, 没有中断所以关中断用一把全局锁代替 */
+typedef struct uparam_posix_sem *uparam_sem_t;
+typedef pthread_mutex_t *uparam_mutex_t;
+
+uparam_sem_t uparam_sem_create(const char *name);
+/* ms小于0时一直等待, 超时返回-RT_ETIMEOUT */
+rt_err_t uparam_sem_take(uparam_sem_t sem, int32_t ms);
+void uparam_sem_release(uparam_sem_t sem);
+uparam_mutex_t uparam_mutex_create(const char *name);
+#define uparam_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define uparam_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+rt_base_t uparam_irq_lock(void);
+void uparam_irq_unlock(rt_base_t level);
+void uparam_delay_ms(int32_t ms);
+/* 统计耗时的时钟, 单位微秒 */
+uint32_t uparam_posix_clock_us(void);
+#define uparam_stats_clock() uparam_posix_clock_us()
+#define UPARAM_STATS_CLOCK_HZ 1000000
+rt_err_t uparam_thread_start(const char *name, void (*entry)(void *param), void *param,
+                             uint32_t stack_size, uint8_t priority);
+
+#endif
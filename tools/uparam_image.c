@@ -0,0 +1,566 @@
+/*
+ * uparam 主机镜像工具
+ * 用和固件相同的 uparam.c 生成参数分区镜像, 工厂烧录固件时一起烧进去, 第一次启动就能直接加载,
+ * 不用再复位默认值并重写一遍flash; 也可以解析从设备读回的镜像, 比较两个镜像的差异.
+ *
+ * gcc -DUPARAM_USING_POSIX -I. -no-pie uparam.c port/uparam_port_posix.c tools/uparam_image.c -o uparam_image
+ * 编译时要加上和固件相同的选项(UPARAM_WRITE_GRAN、UPARAM_CRC_SLOTS、UPARAM_USING_LOG、UPARAM_USING_COMPRESS等),
+ * 否则生成的镜像格式和固件不一致.
+ *
+ * uparam_image [-p 分区大小] [-e 扇区大小] build <描述文件> <镜像> [名称=值 ...]
+ * uparam_image [-e 扇区大小] dump <描述文件> <镜像>
+ * uparam_image [-e 扇区大小] diff <描述文件> <镜像A> <镜像B>
+ *
+ * 描述文件每行一个参数, #开头的是注释:
+ *   名称 类型 长度 [值]
+ *   motor.kp  f   4   1.5
+ *   motor.id  u   4   7
+ *   dev.name  s   16  uparam
+ *   motor.tab vb  8   1 2 3 4
+ * 类型和参数表里的一样(f/d/u/s/vb/vw/vd/vf), 名称和类型要和固件一致, flash里按它们的哈希查找参数.
+ * 没有值的参数写0, 向量的值不够时后面写0. 命令行的 名称=值 覆盖描述文件里的值, 向量用逗号分隔.
+ * 参数按描述文件的顺序存放, 和固件里参数的地址顺序一致时, 固件可以整块读入数据段.
+ * dump 的输出也是描述文件的格式, 镜像里没有的参数输出为注释.
+ */
+#include "uparam.h"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define TOOL_LINE_MAX 4096
+
+typedef struct
+{
+    char *name;
+    char type[4];
+    uint16_t size;
+    /* 在数据区里的偏移 */
+    uint32_t offset;
+} tool_param_struct;
+
+static tool_param_struct *params = RT_NULL;
+static uint32_t param_num = 0;
+/* 所有参数按描述文件的顺序连续存放 */
+static uint8_t *param_data = RT_NULL;
+static uint32_t param_data_size = 0;
+/* 加载时镜像里没有的参数 */
+static uint8_t *param_missing = RT_NULL;
+
+static uint32_t part_size = 64 * 1024;
+static uint32_t sector_size = 4096;
+
+/**
+  * @brief  parse_value
+  * @note   按类型把文本转换成参数数据, 多个值用空格或逗号分隔
+  * @retval 0 成功, -1 格式错误
+  */
+static int parse_value(tool_param_struct *pa, char *text, uint8_t *dst)
+{
+    uint8_t width = 1;
+    uint32_t n = 0;
+    char *token, *end;
+
+    memset(dst, 0, pa->size);
+    if (pa->type[0] == 's')
+    {
+        if (strlen(text) > pa->size)
+        {
+            return -1;
+        }
+        memcpy(dst, text, strlen(text));
+        return 0;
+    }
+    if (pa->type[0] == 'v')
+    {
+        width = (pa->type[1] == 'w') ? 2 : (pa->type[1] == 'd' || pa->type[1] == 'f') ? 4 : 1;
+    }
+    else
+    {
+        width = pa->size;
+    }
+
+    for (token = strtok(text, " \t,"); token != RT_NULL; token = strtok(RT_NULL, " \t,"), n += width)
+    {
+        if (n + width > pa->size)
+        {
+            return -1;
+        }
+        if (pa->type[0] == 'f' || pa->type[1] == 'f')
+        {
+            double d = strtod(token, &end);
+            float f = (float)d;
+            if (width == sizeof(double))
+            {
+                memcpy(dst + n, &d, sizeof(d));
+            }
+            else
+            {
+                memcpy(dst + n, &f, sizeof(f));
+            }
+        }
+        else if (pa->type[0] == 'd')
+        {
+            int64_t v = strtoll(token, &end, 0);
+            memcpy(dst + n, &v, width);
+        }
+        else
+        {
+            uint64_t v = strtoull(token, &end, 0);
+            memcpy(dst + n, &v, width);
+        }
+        if (*end != '\0')
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  print_value
+  * @note   按描述文件的格式输出参数的值
+  * @retval None
+  */
+static void print_value(FILE *out, tool_param_struct *pa, const uint8_t *src)
+{
+    uint8_t width;
+
+    if (pa->type[0] == 's')
+    {
+        fprintf(out, "%.*s", (int)strnlen((const char *)src, pa->size), (const char *)src);
+        return;
+    }
+    width = (pa->type[0] != 'v') ? pa->size : (pa->type[1] == 'w') ? 2 : (pa->type[1] == 'd' || pa->type[1] == 'f') ? 4 : 1;
+    for (uint32_t n = 0; n + width <= pa->size && width > 0; n += width)
+    {
+        uint64_t u = 0;
+
+        if (n > 0)
+        {
+            fputc(' ', out);
+        }
+        memcpy(&u, src + n, width);
+        if ((pa->type[0] == 'f' || pa->type[1] == 'f') && width == sizeof(double))
+        {
+            double d;
+            memcpy(&d, src + n, sizeof(d));
+            fprintf(out, "%.17g", d);
+        }
+        else if (pa->type[0] == 'f' || pa->type[1] == 'f')
+        {
+            float f;
+            memcpy(&f, src + n, sizeof(f));
+            fprintf(out, "%.9g", f);
+        }
+        else if (pa->type[0] == 'd')
+        {
+            //符号扩展
+            uint8_t shift = 64 - width * 8;
+            fprintf(out, "%lld", (long long)((int64_t)(u << shift) >> shift));
+        }
+        else if (pa->type[0] == 'v')
+        {
+            fprintf(out, "0x%0*llX", width * 2, (unsigned long long)u);
+        }
+        else
+        {
+            fprintf(out, "%llu", (unsigned long long)u);
+        }
+    }
+}
+
+/**
+  * @brief  load_desc
+  * @note   读取描述文件, values不为空时解析每个参数的值
+  * @retval 0 成功
+  */
+static int load_desc(const char *path, uint8_t **values)
+{
+    FILE *fp = fopen(path, "r");
+    char line[TOOL_LINE_MAX];
+    uint32_t cap = 0, line_no = 0;
+    char **texts = RT_NULL;
+
+    if (fp == RT_NULL)
+    {
+        printf("open %s failed\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != RT_NULL)
+    {
+        char name[128], type[8], *text;
+        unsigned size;
+        int used = 0;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (sscanf(line, " %127s", name) != 1 || name[0] == '#')
+        {
+            continue;
+        }
+        if (sscanf(line, " %127s %7s %u %n", name, type, &size, &used) != 3 || size == 0 || size > 0xFFFF ||
+            strlen(type) > 3 || strchr("fdusv", type[0]) == RT_NULL || (strchr("fdu", type[0]) != RT_NULL && size > 8))
+        {
+            printf("%s:%u: bad param\n", path, line_no);
+            fclose(fp);
+            return -1;
+        }
+        text = line + used;
+        for (uint32_t i = 0; i < param_num; i++)
+        {
+            //名称和类型都相同的参数在flash里只能按地址保存, 主机上的地址和固件不一样
+            if (!strcmp(params[i].name, name) && !strcmp(params[i].type, type))
+            {
+                printf("%s:%u: param %s is duplicated\n", path, line_no, name);
+                fclose(fp);
+                return -1;
+            }
+        }
+        if (param_num >= cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            params = (tool_param_struct *)realloc(params, cap * sizeof(tool_param_struct));
+            texts = (char **)realloc(texts, cap * sizeof(char *));
+        }
+        params[param_num].name = strdup(name);
+        strcpy(params[param_num].type, type);
+        params[param_num].size = size;
+        //对齐到8字节, 和固件里的变量一样自然对齐
+        params[param_num].offset = UPARAM_ALIGN(param_data_size, 8);
+        param_data_size = params[param_num].offset + size;
+        texts[param_num] = strdup(text);
+        param_num++;
+    }
+    fclose(fp);
+    if (param_num == 0)
+    {
+        printf("%s: no param\n", path);
+        return -1;
+    }
+
+    param_data = (uint8_t *)calloc(1, param_data_size);
+    param_missing = (uint8_t *)calloc(1, param_num);
+    if (values != RT_NULL)
+    {
+        *values = (uint8_t *)calloc(1, param_data_size);
+    }
+    for (uint32_t i = 0; i < param_num; i++)
+    {
+        if (values != RT_NULL && parse_value(&params[i], texts[i], *values + params[i].offset) != 0)
+        {
+            printf("%s: bad value of %s\n", path, params[i].name);
+            return -1;
+        }
+        free(texts[i]);
+    }
+    free(texts);
+    return 0;
+}
+
+static tool_param_struct *find_param(const char *name)
+{
+    for (uint32_t i = 0; i < param_num; i++)
+    {
+        if (!strcmp(params[i].name, name))
+        {
+            return &params[i];
+        }
+    }
+    return RT_NULL;
+}
+
+/* 加载时没有读到的参数会调用默认值回调, 记录下来 */
+static void mark_missing(void *address, uint16_t size)
+{
+    uint32_t offset = (uint8_t *)address - param_data;
+    uint32_t lo = 0, hi = param_num;
+
+    //参数按描述文件的顺序存放, 偏移是递增的
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (params[mid].offset < offset)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo < param_num && params[lo].offset == offset)
+    {
+        param_missing[lo] = 1;
+    }
+    memset(address, 0, size);
+}
+
+/**
+  * @brief  register_params
+  * @note   把描述文件的参数注册到 uparam, values为空时加载镜像, 没读到的参数记录下来
+  * @retval None
+  */
+static param_define_struct *register_params(const uint8_t *values)
+{
+    param_define_struct *list = (param_define_struct *)calloc(param_num, sizeof(param_define_struct));
+
+    for (uint32_t i = 0; i < param_num; i++)
+    {
+        list[i].address = param_data + params[i].offset;
+        list[i].size = params[i].size;
+        list[i].name = params[i].name;
+        list[i].type = params[i].type;
+        if (values != RT_NULL)
+        {
+            list[i].default_value = values + params[i].offset;
+        }
+        else
+        {
+            list[i].default_fun = mark_missing;
+        }
+    }
+    uparam_add_list(list, param_num);
+    return list;
+}
+
+/**
+  * @brief  tool_build
+  * @note   生成镜像: 描述文件和覆盖的值作为默认值, 在空分区上初始化, 和固件第一次启动时一样写入
+  * @retval 0 成功
+  */
+static int tool_build(const char *desc, const char *image, int argc, char **argv)
+{
+    uint8_t *values;
+    uparam_part_t part;
+    FILE *fp;
+
+    if (load_desc(desc, &values) != 0)
+    {
+        return 1;
+    }
+    for (int i = 0; i < argc; i++)
+    {
+        char *eq = strchr(argv[i], '=');
+        tool_param_struct *pa;
+
+        if (eq == RT_NULL)
+        {
+            printf("bad override %s, use name=value\n", argv[i]);
+            return 1;
+        }
+        *eq = '\0';
+        if ((pa = find_param(argv[i])) == RT_NULL || parse_value(pa, eq + 1, values + pa->offset) != 0)
+        {
+            printf("bad override of %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    part = uparam_posix_part_add("param", RT_NULL, part_size, sector_size, 256);
+    if (part == RT_NULL)
+    {
+        printf("partition size %u is not a multiple of sector size %u\n", part_size, sector_size);
+        return 1;
+    }
+    uparam_posix_part_set_gran(part, UPARAM_WRITE_GRAN);
+    register_params(values);
+    //空分区上的头部无效是预期的, 不用输出
+    uparam_posix_log_level = LOG_LVL_ASSERT;
+    uparam_init();
+    uparam_posix_log_level = LOG_LVL_WARNING;
+    if (memcmp(param_data, values, param_data_size) != 0 || uparam_reload() != param_num)
+    {
+        printf("build image failed\n");
+        return 1;
+    }
+
+    if ((fp = fopen(image, "wb")) == RT_NULL || fwrite(part->mem, 1, part->len, fp) != part->len)
+    {
+        printf("write %s failed\n", image);
+        return 1;
+    }
+    fclose(fp);
+    printf("%s: %u params, %u bytes data, %u bytes programmed\n", image, param_num, param_data_size, part->stat.write_bytes);
+    return 0;
+}
+
+/**
+  * @brief  print_header
+  * @note   输出镜像头部, 日志模式没有镜像头部
+  * @retval None
+  */
+static void print_header(FILE *out, const uint8_t *mem)
+{
+#ifndef UPARAM_USING_LOG
+    param_header_struct header;
+
+    memcpy(&header, mem, sizeof(header));
+    if (header.header != UPARAM_HEADER_MAGIC)
+    {
+        fprintf(out, "# header: invalid\n");
+        return;
+    }
+    fprintf(out, "# header: version %u%s, params %u, data %u bytes, layout 0x%08X, crc %s\n",
+            header.version & ~UPARAM_FORMAT_RLE, (header.version & UPARAM_FORMAT_RLE) ? " rle" : "",
+            header.cnt.u32, header.size.u32, header.layout,
+            header.crc == uparam_crc32(0, &header, sizeof(header) - 8) ? "ok" : "bad");
+#else
+    fprintf(out, "# log image\n");
+#endif
+}
+
+/**
+  * @brief  load_image
+  * @note   在子进程里加载镜像, uparam 只能初始化一次, 参数数据和没读到的标记通过共享内存返回
+  * @param  *shared: 参数数据加上每个参数一字节的标记
+  * @retval 0 成功
+  */
+static int load_image(const char *image, uint8_t *shared)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+        uparam_part_t part;
+        FILE *fp = fopen(image, "rb");
+        long len;
+
+        if (fp == RT_NULL)
+        {
+            printf("open %s failed\n", image);
+            _exit(1);
+        }
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        part = uparam_posix_part_add("param", RT_NULL, len, sector_size, 256);
+        if (part == RT_NULL || fread(part->mem, 1, len, fp) != (size_t)len)
+        {
+            printf("%s: size %ld is not a multiple of sector size %u\n", image, len, sector_size);
+            _exit(1);
+        }
+        fclose(fp);
+        uparam_posix_part_set_gran(part, UPARAM_WRITE_GRAN);
+        print_header(stdout, part->mem);
+        register_params(RT_NULL);
+        uparam_init();
+        memcpy(shared, param_data, param_data_size);
+        memcpy(shared + param_data_size, param_missing, param_num);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t *load_shared(void)
+{
+    void *mem = mmap(RT_NULL, param_data_size + param_num, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    return (mem == MAP_FAILED) ? RT_NULL : (uint8_t *)mem;
+}
+
+static int tool_dump(const char *desc, const char *image)
+{
+    uint8_t *shared;
+
+    if (load_desc(desc, RT_NULL) != 0 || (shared = load_shared()) == RT_NULL || load_image(image, shared) != 0)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < param_num; i++)
+    {
+        tool_param_struct *pa = &params[i];
+
+        if (shared[param_data_size + i])
+        {
+            printf("# missing: %s %s %u\n", pa->name, pa->type, pa->size);
+            continue;
+        }
+        printf("%-16s %-3s %-5u ", pa->name, pa->type, pa->size);
+        print_value(stdout, pa, shared + pa->offset);
+        printf("\n");
+    }
+    return 0;
+}
+
+static int tool_diff(const char *desc, const char *image_a, const char *image_b)
+{
+    uint8_t *a, *b;
+    uint32_t diff = 0;
+
+    if (load_desc(desc, RT_NULL) != 0 || (a = load_shared()) == RT_NULL || (b = load_shared()) == RT_NULL ||
+        load_image(image_a, a) != 0 || load_image(image_b, b) != 0)
+    {
+        return 2;
+    }
+    for (uint32_t i = 0; i < param_num; i++)
+    {
+        tool_param_struct *pa = &params[i];
+        uint8_t miss_a = a[param_data_size + i], miss_b = b[param_data_size + i];
+
+        if (miss_a == miss_b && (miss_a || memcmp(a + pa->offset, b + pa->offset, pa->size) == 0))
+        {
+            continue;
+        }
+        diff++;
+        printf("%-16s ", pa->name);
+        miss_a ? printf("(missing)") : print_value(stdout, pa, a + pa->offset);
+        printf(" -> ");
+        miss_b ? printf("(missing)") : print_value(stdout, pa, b + pa->offset);
+        printf("\n");
+    }
+    printf("%u of %u params differ\n", diff, param_num);
+    return diff ? 1 : 0;
+}
+
+static void usage(void)
+{
+    printf("Usage:\n"
+           "uparam_image [-p part_size] [-e sector_size] build <desc> <image> [name=value ...]\n"
+           "uparam_image [-e sector_size] dump <desc> <image>\n"
+           "uparam_image [-e sector_size] diff <desc> <image_a> <image_b>\n");
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:e:")) != -1)
+    {
+        if (opt == 'p')
+        {
+            part_size = strtoul(optarg, RT_NULL, 0);
+        }
+        else if (opt == 'e')
+        {
+            sector_size = strtoul(optarg, RT_NULL, 0);
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc >= 3 && !strcmp(argv[0], "build"))
+    {
+        return tool_build(argv[1], argv[2], argc - 3, argv + 3);
+    }
+    if (argc == 3 && !strcmp(argv[0], "dump"))
+    {
+        return tool_dump(argv[1], argv[2]);
+    }
+    if (argc == 4 && !strcmp(argv[0], "diff"))
+    {
+        return tool_diff(argv[1], argv[2], argv[3]);
+    }
+    usage();
+    return 2;
+}
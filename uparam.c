@@ -1,6 +1,4 @@
 #include "uparam.h"
-#include <fal.h>
-#include <finsh.h>
 
 #define UPARAM_DEBUG
 #define UPARAM_FINSH
@@ -11,329 +9,5250 @@
 #else
 #define LOG_LVL LOG_LVL_WARNING
 #endif
+#ifndef UPARAM_USING_POSIX
 #include <ulog.h>
+#endif
 
 #define DEFAULT_PRA_PART "param"
 
 static char *praram_partition = DEFAULT_PRA_PART;
-static const struct fal_partition *par_part = RT_NULL;
+/* 当前读写的分区和存储区在分区里的开始位置, 镜像模式下加载和保存时依次切换到每个存储区 */
+static uparam_part_t par_part = RT_NULL;
+static uint32_t par_base = 0;
 
 /* 写数据覆盖保护，必须等读取后才能写入 */
 static int8_t write_protect = 0;
-/* 参数表 */
-static param_struct *ls = 0;
+/* 参数表, 链接段注册时指向链接段 */
+static const param_struct *ls = 0;
 /* 参数表在内存的索引 */
 static uint32_t param_index = 0;
 
 /* 保存到flash的结构头部信息 */
 static param_header_struct param_header;
 
+/* 运行时参数索引, 按全局序号(参数表的添加顺序)存放地址、长度和类型, 和地址索引一起建立.
+ * 参数表是1字节对齐的, 扫描时只读这几个自然对齐的数组 */
+static uint8_t **par_addr = RT_NULL;
+static uint16_t *par_size = RT_NULL;
+/* 类型字符串的第一个字符 */
+static char *par_type = RT_NULL;
+/* 每个参数表第一个参数的全局序号, 最后一项是参数总数 */
+static uint32_t *list_base = RT_NULL;
+#define PAR_G(li, i) (list_base[li] + (i))
+/* 地址索引第n项的全局序号 */
+#define ADDR_G(n) PAR_G(addr_index[n].list, addr_index[n].index)
+/* 每个参数表所在的存储区, 和运行时索引在同一块内存里 */
+static uint8_t *list_store = RT_NULL;
+
+/* 指定了存储区的参数表, 建立索引时转换成 list_store */
+static struct
+{
+    param_list *list;
+    uint8_t store;
+} store_lists[UPARAM_STORE_LIST_MAX];
+static uint8_t store_list_num = 0;
+
+/* 地址索引, 第一次加载前建立, 添加参数表后失效 */
+static param_addr_index_struct *addr_index = RT_NULL;
+static uint32_t addr_index_num = 0;
+
+/* ID索引, 和地址索引一起建立, 加载时查找flash记录对应的参数 */
+static param_id_index_struct *id_index = RT_NULL;
+
+/* 名称索引, 第一次按名称查找时建立, 添加参数表后失效 */
+static param_name_index_struct *name_index = RT_NULL;
+
+#ifndef UPARAM_USING_LOG
+/* 存储区, 第0个是默认分区, 保存没有指定存储区的参数表 */
+static param_store_struct stores[UPARAM_STORE_MAX];
+static uint8_t store_num = 1;
+/* 当前加载或者保存的存储区 */
+static param_store_struct *store = &stores[0];
+/* 参数表在当前存储区里 */
+#define IN_STORE(li) (list_store[li] == store - stores)
+/* 保存的格式, 版本号加上压缩标记 */
+#ifdef UPARAM_USING_COMPRESS
+#define IMAGE_FORMAT (UPARAM_FORMAT_VERSION | UPARAM_FORMAT_RLE)
+#else
+#define IMAGE_FORMAT UPARAM_FORMAT_VERSION
+#endif
+/* 第一个CRC槽的位置, 每个槽按最小写入单位对齐 */
+#define IMAGE_SLOT_OFFSET UPARAM_ALIGN(sizeof(param_header_struct), UPARAM_WRITE_GRAN)
+#define IMAGE_SLOT_SIZE UPARAM_ALIGN(4, UPARAM_WRITE_GRAN)
+/* 目录(旧版本为记录)开始的位置 */
+#define IMAGE_DATA_OFFSET (IMAGE_SLOT_OFFSET + UPARAM_CRC_SLOTS * IMAGE_SLOT_SIZE)
+/* "UPC1", 计数器存储区的扇区头部之后是按最小写入单位对齐的记录 */
+#define UPARAM_COUNTER_MAGIC 0x31435055
+#define COUNTER_DATA_START ((uint32_t)UPARAM_ALIGN(sizeof(param_counter_sector_struct), UPARAM_WRITE_GRAN))
+#define COUNTER_REC_SIZE ((uint32_t)UPARAM_ALIGN(sizeof(param_counter_rec_struct), UPARAM_WRITE_GRAN))
+#else
+/* 日志模式只有一个存储区 */
+#define IN_STORE(li) 1
+#endif
+
+/* 上一次写入的编程次数 */
+static uint32_t last_prog_calls = 0;
+
+/* 调用者提供的读缓冲 */
+static uint8_t *read_buf = RT_NULL;
+static uint32_t read_buf_size = 0;
+
+/* 默认的读缓冲和写入页缓冲, 加载和保存不在栈上分配缓冲 */
+static uint8_t io_read_buf[UPARAM_READ_BUF_SIZE];
+static uint8_t io_write_buf[UPARAM_WRITE_PAGE_SIZE];
+
+#if defined(UPARAM_USING_ASYNC_FLUSH) || defined(UPARAM_USING_LOCK)
+#define UPARAM_USING_FLUSH_LOCK
+/* 保存锁, 保存、重新加载和擦除互斥 */
+static uparam_mutex_t flush_lock = RT_NULL;
+#endif
+
+#ifdef UPARAM_USING_LOCK
+/* 写者锁, 修改参数内存和取保存快照互斥, 顺序在保存锁之后 */
+static uparam_mutex_t write_lock = RT_NULL;
+/* 写者临界区的中断状态, 写者已经互斥, 只需要一份 */
+static rt_base_t write_level;
+/* 参数内存的修改序号, 奇数表示正在修改 */
+volatile uint32_t uparam_seq = 0;
+#endif
+
+#ifndef UPARAM_USING_LOG
+/* 保存用的数据段快照, 按地址顺序排列, 为空时直接使用参数内存 */
+static uint8_t *flush_snap = RT_NULL;
+#endif
+
+#if defined(UPARAM_USING_LOCK) && !defined(UPARAM_USING_LOG)
+/* 保存时使用的修改标记, 保存期间新的修改留在dirty里 */
+#define FLUSH_DIRTY(li) (ls[li].flushing)
+#else
+#define FLUSH_DIRTY(li) (ls[li].dirty)
+#endif
+
+#ifdef UPARAM_USING_ASYNC_FLUSH
+/* 唤醒后台线程 */
+static uparam_sem_t flush_req_sem = RT_NULL;
+/* 通知等待保存完成的线程 */
+static uparam_sem_t flush_done_sem = RT_NULL;
+/* 已发出请求, 后台线程还没开始保存 */
+static volatile uint8_t flush_pending = 0;
+/* 请求序号和已完成的序号, 序号回绕时按差值比较 */
+static volatile uint32_t flush_req_gen = 0;
+static volatile uint32_t flush_done_gen = 0;
+/* 最近完成的一次保存失败, 和 flush_done_gen 一起更新 */
+static volatile uint8_t flush_done_failed = 0;
+/* 正在等待的线程数 */
+static uint32_t flush_waiters = 0;
+#endif
+
+#ifdef UPARAM_USING_STATS
+/* 运行统计 */
+static param_stats_struct stats;
+#endif
+
+#ifdef UPARAM_USING_NOTIFY
+/* 订阅者表 */
+static param_subscriber_struct *subscribers = RT_NULL;
+static uint32_t subscriber_num = 0;
+/* 订阅者表锁, 通知期间一直持有 */
+static uparam_mutex_t notify_lock = RT_NULL;
+/* 唤醒通知线程 */
+static uparam_sem_t notify_sem = RT_NULL;
+/* 已经唤醒, 通知线程还没有开始处理 */
+static volatile uint8_t notify_pending = 0;
+#endif
+
+#ifdef UPARAM_USING_FLUSH_LOCK
+static void storage_lock(void)
+{
+    if (flush_lock != RT_NULL)
+    {
+        uparam_mutex_lock(flush_lock);
+    }
+}
+
+static void storage_unlock(void)
+{
+    if (flush_lock != RT_NULL)
+    {
+        uparam_mutex_unlock(flush_lock);
+    }
+}
+#else
+#define storage_lock()
+#define storage_unlock()
+#endif
+
+#ifdef UPARAM_USING_LOCK
+static void param_lock(void)
+{
+    if (write_lock != RT_NULL)
+    {
+        uparam_mutex_lock(write_lock);
+    }
+}
+
+static void param_unlock(void)
+{
+    if (write_lock != RT_NULL)
+    {
+        uparam_mutex_unlock(write_lock);
+    }
+}
+
+/**
+  * @brief  seq_begin
+  * @note   开始修改参数内存. 关中断保证读者不会在修改的中间打断写者后一直等待,
+  *         临界区里只做复制, 调用前要持有写者锁
+  * @retval None
+  */
+static void seq_begin(void)
+{
+    write_level = uparam_irq_lock();
+    uparam_seq++;
+    uparam_wmb();
+}
+
+static void seq_end(void)
+{
+    uparam_wmb();
+    uparam_seq++;
+    uparam_irq_unlock(write_level);
+}
+
+/**
+  * @brief  uparam_write_begin
+  * @note   应用直接修改参数变量前调用, 和 uparam_write_end 之间只做赋值
+  * @retval None
+  */
+void uparam_write_begin(void)
+{
+    param_lock();
+    seq_begin();
+}
+
+void uparam_write_end(void)
+{
+    seq_end();
+    param_unlock();
+}
+#else
+#define param_lock()
+#define param_unlock()
+#define seq_begin()
+#define seq_end()
+#endif
+
+#ifdef UPARAM_USING_LOCK
+/* 整个参数先读到这里再复制, 持有写者锁时使用 */
+static uint8_t copy_buf[UPARAM_COPY_BUF_SIZE];
+#endif
+
+/**
+  * @brief  param_write
+  * @note   在一个写者临界区里写入整个参数, 不加锁的读者不会读到一半新一半旧的值. 内容相同时不写入
+  * @retval 1 内容有变化, 0 没有变化
+  */
+static int param_write(uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    if (memcmp(dst, src, size) == 0)
+    {
+        return 0;
+    }
+    seq_begin();
+    memcpy(dst, src, size);
+    seq_end();
+    return 1;
+}
+
+#ifdef UPARAM_USING_NOTIFY
+/**
+  * @brief  notify_mark
+  * @note   标记参数需要通知, 可能和通知线程同时访问, 在关中断里置位
+  * @retval None
+  */
+static void notify_mark(uint16_t li, uint16_t i)
+{
+    rt_base_t level = uparam_irq_lock();
+    ls[li].changed[i / 8] |= 1 << (i % 8);
+    uparam_irq_unlock(level);
+}
+
+/**
+  * @brief  notify_request
+  * @note   唤醒通知线程, 通知线程处理前的多次请求只释放一次信号量, 可以在中断里调用
+  * @retval None
+  */
+static void notify_request(void)
+{
+    rt_base_t level;
+    uint8_t wake;
+
+    if (notify_sem == RT_NULL)
+    {
+        return;
+    }
+    level = uparam_irq_lock();
+    wake = !notify_pending;
+    notify_pending = 1;
+    uparam_irq_unlock(level);
+    if (wake)
+    {
+        uparam_sem_release(notify_sem);
+    }
+}
+#else
+#define notify_mark(li, i)
+#define notify_request()
+#endif
+
+#ifdef UPARAM_USING_STATS
+#define stats_clock() uparam_stats_clock()
+#define stats_add(field, n) (stats.field += (n))
+#define stats_set(field, n) (stats.field = (n))
+
+/**
+  * @brief  stats_time
+  * @note   记录一次耗时, 直方图按耗时的二进制位数分桶
+  * @param  *t: 统计项
+  * @param  start: 开始时的 stats_clock()
+  * @retval None
+  */
+static void stats_time(param_stats_time_struct *t, uint32_t start)
+{
+    uint32_t time = (uint32_t)stats_clock() - start;
+    uint32_t bucket = 0;
+
+    while (bucket < UPARAM_STATS_BUCKETS - 1 && (time >> bucket) != 0)
+    {
+        bucket++;
+    }
+    t->count++;
+    t->total += time;
+    t->last = time;
+    t->max = (time > t->max) ? time : t->max;
+    t->hist[bucket]++;
+}
+
+/**
+  * @brief  uparam_stats_get
+  * @note   读出运行统计, 统计时不加锁, 和正在进行的操作同时读时个别计数可能差一次
+  * @retval None
+  */
+void uparam_stats_get(param_stats_struct *out)
+{
+    memcpy(out, &stats, sizeof(param_stats_struct));
+}
+
+void uparam_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(param_stats_struct));
+}
+#else
+#define stats_clock() 0
+#define stats_add(field, n)
+#define stats_set(field, n)
+#define stats_time(t, start) ((void)(start))
+#endif
+
+/* flash读写擦都经过这几个函数, 统计调用次数和字节数. 地址相对当前存储区的开始位置 */
+static int flash_read(uparam_part_t part, uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    stats_add(read_calls, 1);
+    stats_add(read_bytes, size);
+    return uparam_part_read(part, par_base + addr, buf, size);
+}
+
+static int flash_write(uparam_part_t part, uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+    stats_add(prog_calls, 1);
+    stats_add(prog_bytes, size);
+    return uparam_part_write(part, par_base + addr, buf, size);
+}
+
+static int flash_erase(uparam_part_t part, uint32_t addr, uint32_t size)
+{
+    uint32_t start = stats_clock();
+    int result = uparam_part_erase(part, par_base + addr, size);
+
+    stats_time(&stats.erase, start);
+    stats_add(erase_bytes, size);
+    return result;
+}
+
+/**
+  * @brief  uparam_lock_init
+  * @note   创建保存锁、写者锁和订阅者表锁, 只创建一次
+  * @retval RT_EOK 成功
+  */
+static rt_err_t uparam_lock_init(void)
+{
+#ifdef UPARAM_USING_FLUSH_LOCK
+    if (flush_lock == RT_NULL && (flush_lock = uparam_mutex_create("par_lock")) == RT_NULL)
+    {
+        return RT_ERROR;
+    }
+#endif
+#ifdef UPARAM_USING_LOCK
+    if (write_lock == RT_NULL && (write_lock = uparam_mutex_create("par_wr")) == RT_NULL)
+    {
+        return RT_ERROR;
+    }
+#endif
+#ifdef UPARAM_USING_NOTIFY
+    if (notify_lock == RT_NULL && (notify_lock = uparam_mutex_create("par_ntf")) == RT_NULL)
+    {
+        return RT_ERROR;
+    }
+#endif
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_index_reset
+  * @note   参数表变化, 地址、ID和名称索引需要重建
+  * @retval None
+  */
+static void uparam_index_reset(void)
+{
+    //运行时索引的几个数组在同一块内存里
+    UPARAM_FREE(par_addr);
+    par_addr = RT_NULL;
+    UPARAM_FREE(addr_index);
+    addr_index = RT_NULL;
+    addr_index_num = 0;
+    UPARAM_FREE(id_index);
+    id_index = RT_NULL;
+    UPARAM_FREE(name_index);
+    name_index = RT_NULL;
+}
+
+#ifndef UPARAM_USING_SECTION
+/**
+  * @brief  uparam_add_list
+  * @note   添加参数表
+  * @param  *list_address: 参数表地址
+  * @param  list_size:   包含参数的个数
+  * @retval 
+  */
+rt_err_t uparam_add_list(param_list *list_address, uint16_t list_size)
+{
+    param_list *pa_this;
+
+    //先遍历一下参数表是否已经添加过
+    for (int i = 0; i < param_index; i++)
+    {
+        pa_this = ls[i].par_list_add;
+
+        if (pa_this == list_address)
+        {
+            LOG_E("param list is exist, address: 0x%X", (uint32_t)(rt_ubase_t)list_address);
+            return RT_ERROR;
+        }
+    }
+
+    //分配内存, 失败时原来的参数表不变
+    param_struct *new_ls = (param_struct *)UPARAM_REALLOC((void *)ls, (param_index + 1) * sizeof(param_struct));
+    if (new_ls == RT_NULL)
+    {
+        LOG_E("uparam realloc memory failed");
+        return RT_ERROR;
+    }
+    ls = new_ls;
+
+    //按位标记参数是否有效和是否修改过, 几组标记一起分配
+    uint16_t bit_num = UPARAM_BIT_BYTES(list_size);
+    param_struct *pl = &new_ls[param_index];
+#ifdef UPARAM_USING_LOG
+    //日志模式下记录位置放在前面, 保证对齐
+    uint32_t *loc = (uint32_t *)UPARAM_MALLOC(list_size * sizeof(uint32_t) + bit_num * UPARAM_BIT_GROUPS);
+    if (loc == RT_NULL)
+    {
+        LOG_E("uparam malloc memory failed");
+        return RT_ERROR;
+    }
+    memset(loc, 0xFF, list_size * sizeof(uint32_t));
+    pl->log_loc = loc;
+    pl->read_valid = (uint8_t *)(loc + list_size);
+#else
+    pl->read_valid = (uint8_t *)UPARAM_MALLOC(bit_num * UPARAM_BIT_GROUPS);
+    if (pl->read_valid == RT_NULL)
+    {
+        LOG_E("uparam malloc memory failed");
+        return RT_ERROR;
+    }
+#endif
+    memset(pl->read_valid, 0, bit_num * UPARAM_BIT_GROUPS);
+    pl->par_list_add = list_address;
+    pl->par_list_size = list_size;
+    uint8_t *bits = pl->read_valid + bit_num;
+    pl->dirty = bits;
+#if UPARAM_FLUSHING_GROUPS
+    bits += bit_num;
+    pl->flushing = bits;
+#endif
+#ifdef UPARAM_USING_NOTIFY
+    bits += bit_num;
+    pl->changed = bits;
+    bits += bit_num;
+    pl->notifying = bits;
+#endif
+    param_index++;
+
+    for (int i = 0; i < list_size; i++)
+    {
+        pa_this = list_address + i;
+        param_header.size.u32 += pa_this->size;
+        LOG_D("add param suc,name: %s , address: 0x%X, size: %d", pa_this->name, (uint32_t)(rt_ubase_t)pa_this->address, pa_this->size);
+    }
+    param_header.cnt.u32 += list_size;
+
+    uparam_index_reset();
+    LOG_D("add param list success, list size: %d, data size total: %d", list_size, param_header.size.u32);
+    return RT_EOK;
+}
+#else
+rt_err_t uparam_add_list(param_list *list_address, uint16_t list_size)
+{
+    LOG_E("param list must be registered with UPARAM_LIST_EXPORT");
+    return RT_ERROR;
+}
+
+/**
+  * @brief  uparam_section_load
+  * @note   遍历链接段里的参数表, 统计参数个数和数据长度, 不分配内存
+  * @retval None
+  */
+static void uparam_section_load(void)
+{
+    ls = (const param_struct *)uparam_section_begin();
+    param_index = (const param_struct *)uparam_section_end() - ls;
+    param_header.cnt.u32 = 0;
+    param_header.size.u32 = 0;
+
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            param_header.size.u32 += ls[li].par_list_add[i].size;
+        }
+        param_header.cnt.u32 += ls[li].par_list_size;
+#ifdef UPARAM_USING_LOG
+        memset(ls[li].log_loc, 0xFF, ls[li].par_list_size * sizeof(uint32_t));
+#endif
+    }
+    uparam_index_reset();
+    LOG_D("load %d param lists from section, data size total: %d", param_index, param_header.size.u32);
+}
+#endif
+
+#define FNV1A_OFFSET 2166136261u
+#define FNV1A_PRIME 16777619u
+
+/**
+  * @brief  fnv1a
+  * @note   FNV-1a 32位哈希, 从hash开始累加字符串, 包括结尾的0
+  * @retval 
+  */
+static uint32_t fnv1a(uint32_t hash, const char *str)
+{
+    while (str != RT_NULL && *str)
+    {
+        hash ^= (uint8_t)*str++;
+        hash *= FNV1A_PRIME;
+    }
+    return hash * FNV1A_PRIME;
+}
+
+/**
+  * @brief  name_hash
+  * @note   名称的FNV-1a哈希, 只用于内存里的名称索引
+  * @retval 
+  */
+static uint32_t name_hash(const char *name)
+{
+    return fnv1a(FNV1A_OFFSET, name);
+}
+
+/**
+  * @brief  param_id
+  * @note   参数ID, 名称和类型的FNV-1a哈希, 保存在目录和日志记录里代替内存地址,
+  *         重新链接后地址变化也能找到. 没有名称的参数只能用地址, 重名的见 param_key
+  * @retval 
+  */
+static uint32_t param_id(param_list *pa)
+{
+    if (pa->name == RT_NULL)
+    {
+        return (uint32_t)(rt_ubase_t)pa->address;
+    }
+    return fnv1a(fnv1a(FNV1A_OFFSET, pa->name), pa->type);
+}
+
+/**
+  * @brief  addr_index_cmp
+  * @note   地址索引排序, 地址相同时保持参数表的添加顺序
+  * @retval 
+  */
+static int addr_index_cmp(const void *a, const void *b)
+{
+    const param_addr_index_struct *ia = (const param_addr_index_struct *)a;
+    const param_addr_index_struct *ib = (const param_addr_index_struct *)b;
+
+    if (ia->address != ib->address)
+    {
+        return ia->address < ib->address ? -1 : 1;
+    }
+    if (ia->list != ib->list)
+    {
+        return ia->list < ib->list ? -1 : 1;
+    }
+    return ia->index < ib->index ? -1 : (ia->index > ib->index);
+}
+
+/**
+  * @brief  id_index_cmp
+  * @note   ID索引排序, ID相同时按参数表的添加顺序
+  * @retval 
+  */
+static int id_index_cmp(const void *a, const void *b)
+{
+    const param_id_index_struct *ia = (const param_id_index_struct *)a;
+    const param_id_index_struct *ib = (const param_id_index_struct *)b;
+
+    if (ia->id != ib->id)
+    {
+        return ia->id < ib->id ? -1 : 1;
+    }
+    if (ia->list != ib->list)
+    {
+        return ia->list < ib->list ? -1 : 1;
+    }
+    return ia->index < ib->index ? -1 : (ia->index > ib->index);
+}
+
+/**
+  * @brief  param_key
+  * @note   参数保存到flash时用的ID, 在ID索引里查找. 建索引时ID重复的参数已经换成了地址
+  * @param  list: 所在参数表
+  * @param  index: 在参数表里的序号
+  * @retval 参数ID, 重名时为参数地址
+  */
+static uint32_t param_key(uint16_t list, uint16_t index)
+{
+    param_id_index_struct key;
+
+    key.id = param_id(&ls[list].par_list_add[index]);
+    key.list = list;
+    key.index = index;
+    if (bsearch(&key, id_index, addr_index_num, sizeof(param_id_index_struct), id_index_cmp) == RT_NULL)
+    {
+        return (uint32_t)(rt_ubase_t)par_addr[PAR_G(list, index)];
+    }
+    return key.id;
+}
+
+/**
+  * @brief  uparam_build_index
+  * @note   建立运行时索引(每个参数7字节加一个指针, 每个参数表5字节), 按地址排序和按ID排序的参数索引
+  *         (每个参数各8字节), 同时计算每个存储区的布局指纹
+  * @retval RT_EOK 成功
+  */
+static rt_err_t uparam_build_index(void)
+{
+    uint32_t num = param_header.cnt.u32;
+    uint32_t n = 0;
+
+    if (addr_index != RT_NULL)
+    {
+        return RT_EOK;
+    }
+
+    //按对齐从大到小排列: 地址, 参数表的开始序号, 长度, 类型
+    par_addr = (uint8_t **)UPARAM_MALLOC(num * sizeof(uint8_t *) + (param_index + 1) * sizeof(uint32_t) + num * 3 + param_index);
+    addr_index = (param_addr_index_struct *)UPARAM_MALLOC(num * sizeof(param_addr_index_struct) + 1);
+    id_index = (param_id_index_struct *)UPARAM_MALLOC(num * sizeof(param_id_index_struct) + 1);
+    if (par_addr == RT_NULL || addr_index == RT_NULL || id_index == RT_NULL)
+    {
+        LOG_E("uparam index malloc failed, size: %d", (int)(num * (sizeof(param_addr_index_struct) * 2 + sizeof(uint8_t *) + 3)));
+        uparam_index_reset();
+        return RT_ERROR;
+    }
+    list_base = (uint32_t *)(par_addr + num);
+    par_size = (uint16_t *)(list_base + param_index + 1);
+    par_type = (char *)(par_size + num);
+    list_store = (uint8_t *)(par_type + num);
+
+    for (int li = 0; li < param_index; li++)
+    {
+        list_base[li] = n;
+        list_store[li] = 0;
+        for (int k = 0; k < store_list_num; k++)
+        {
+            if (store_lists[k].list == ls[li].par_list_add)
+            {
+                list_store[li] = store_lists[k].store;
+            }
+        }
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            param_list *pa = &ls[li].par_list_add[i];
+
+            par_addr[n] = (uint8_t *)pa->address;
+            par_size[n] = pa->size;
+            par_type[n] = (pa->type != RT_NULL) ? pa->type[0] : 0;
+            addr_index[n].address = (uint32_t)(rt_ubase_t)pa->address;
+            addr_index[n].list = li;
+            addr_index[n].index = i;
+            id_index[n].id = param_id(pa);
+            id_index[n].list = li;
+            id_index[n].index = i;
+            n++;
+        }
+    }
+    list_base[param_index] = n;
+    qsort(addr_index, n, sizeof(param_addr_index_struct), addr_index_cmp);
+    qsort(id_index, n, sizeof(param_id_index_struct), id_index_cmp);
+    addr_index_num = n;
+
+    //名称和类型都相同的参数分不出来, 这些参数还是按地址保存
+    uint8_t dup = 0;
+    for (n = 0; n < addr_index_num;)
+    {
+        uint32_t end = n + 1;
+        while (end < addr_index_num && id_index[end].id == id_index[n].id)
+        {
+            end++;
+        }
+        if (end - n > 1)
+        {
+            LOG_W("param id is duplicated: %s, saved by address", ls[id_index[n].list].par_list_add[id_index[n].index].name);
+            for (; n < end; n++)
+            {
+                id_index[n].id = (uint32_t)(rt_ubase_t)par_addr[PAR_G(id_index[n].list, id_index[n].index)];
+            }
+            dup = 1;
+        }
+        n = end;
+    }
+    if (dup)
+    {
+        qsort(id_index, addr_index_num, sizeof(param_id_index_struct), id_index_cmp);
+    }
+
+#ifndef UPARAM_USING_LOG
+    //每个存储区的参数个数、数据长度和布局指纹, 布局指纹就是按地址顺序生成的目录的CRC
+    for (int s = 0; s < store_num; s++)
+    {
+        stores[s].header.cnt.u32 = 0;
+        stores[s].header.size.u32 = 0;
+        stores[s].layout = 0;
+    }
+    for (n = 0; n < addr_index_num; n++)
+    {
+        param_store_struct *st = &stores[list_store[addr_index[n].list]];
+        param_p entry;
+
+        entry.id = param_key(addr_index[n].list, addr_index[n].index);
+        entry.size = par_size[ADDR_G(n)];
+        st->layout = uparam_crc32(st->layout, &entry, sizeof(param_p));
+        st->header.cnt.u32++;
+        st->header.size.u32 += entry.size;
+    }
+#endif
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  find_param_by_address
+  * @note   二分查找地址相同且长度一致的参数
+  * @param  address: 参数地址
+  * @param  size: 参数长度, 0为不检查长度
+  * @retval 找到的索引项, 没有返回RT_NULL
+  */
+static param_addr_index_struct *find_param_by_address(uint32_t address, uint16_t size)
+{
+    uint32_t lo = 0, hi = addr_index_num;
+
+    //找到第一个地址不小于address的位置
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (addr_index[mid].address < address)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for (; lo < addr_index_num && addr_index[lo].address == address; lo++)
+    {
+        uint16_t size_this = par_size[ADDR_G(lo)];
+        //是否存在 并且 size相同, size为0时不检查
+        if (size == 0 || size_this == size)
+        {
+            return &addr_index[lo];
+        }
+        LOG_W("target size is different, size: %d", size_this);
+    }
+    return RT_NULL;
+}
+
+/**
+  * @brief  find_param_by_id
+  * @note   二分查找ID相同且长度一致的参数
+  * @retval 找到的索引项, 没有返回RT_NULL
+  */
+static param_id_index_struct *find_param_by_id(uint32_t id, uint16_t size)
+{
+    uint32_t lo = 0, hi = addr_index_num;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (id_index[mid].id < id)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for (; lo < addr_index_num && id_index[lo].id == id; lo++)
+    {
+        uint32_t g = PAR_G(id_index[lo].list, id_index[lo].index);
+        if (par_size[g] == size)
+        {
+            return &id_index[lo];
+        }
+        LOG_W("param %s size is changed, %d -> %d", ls[id_index[lo].list].par_list_add[id_index[lo].index].name, size, par_size[g]);
+    }
+    return RT_NULL;
+}
+
+/**
+  * @brief  find_param_by_key
+  * @note   查找flash记录对应的参数, 当前格式按ID查找, 旧格式按地址
+  * @param  key: 记录里的ID或者地址
+  * @param  by_address: 旧格式的记录
+  * @param  *list: 返回所在参数表
+  * @param  *index: 返回在参数表里的序号
+  * @retval 1 找到, 0 不存在
+  */
+static int find_param_by_key(uint32_t key, uint16_t size, uint8_t by_address, uint16_t *list, uint16_t *index)
+{
+    if (by_address)
+    {
+        param_addr_index_struct *found = find_param_by_address(key, size);
+        if (found != RT_NULL)
+        {
+            *list = found->list;
+            *index = found->index;
+            return 1;
+        }
+    }
+    else
+    {
+        param_id_index_struct *found = find_param_by_id(key, size);
+        if (found != RT_NULL)
+        {
+            *list = found->list;
+            *index = found->index;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  uparam_set_dirty
+  * @note   标记参数已修改, 下次保存时写入
+  * @param  *address: 参数地址
+  * @retval RT_EOK 成功
+  */
+rt_err_t uparam_set_dirty(void *address)
+{
+    param_addr_index_struct *found;
+
+    if (uparam_build_index() != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    found = find_param_by_address((uint32_t)(rt_ubase_t)address, 0);
+    if (found == RT_NULL)
+    {
+        LOG_W("param is not exist, address: 0x%X", (uint32_t)(rt_ubase_t)address);
+        return RT_ERROR;
+    }
+    param_lock();
+    ls[found->list].dirty[found->index / 8] |= 1 << (found->index % 8);
+    param_unlock();
+    notify_mark(found->list, found->index);
+    notify_request();
+
+    return RT_EOK;
+}
+
+static int name_index_cmp(const void *a, const void *b)
+{
+    const param_name_index_struct *ia = (const param_name_index_struct *)a;
+    const param_name_index_struct *ib = (const param_name_index_struct *)b;
+
+    if (ia->hash != ib->hash)
+    {
+        return ia->hash < ib->hash ? -1 : 1;
+    }
+    if (ia->list != ib->list)
+    {
+        return ia->list < ib->list ? -1 : 1;
+    }
+    return ia->index < ib->index ? -1 : (ia->index > ib->index);
+}
+
+/**
+  * @brief  uparam_build_name_index
+  * @note   建立按名称哈希排序的索引, 每个参数8字节, 只有用到名称查找时才建立
+  * @retval RT_EOK 成功
+  */
+static rt_err_t uparam_build_name_index(void)
+{
+    uint32_t n = 0;
+
+    if (name_index != RT_NULL)
+    {
+        return RT_EOK;
+    }
+
+    name_index = (param_name_index_struct *)UPARAM_MALLOC(param_header.cnt.u32 * sizeof(param_name_index_struct) + 1);
+    if (name_index == RT_NULL)
+    {
+        LOG_E("uparam name index malloc failed, size: %d", (int)(param_header.cnt.u32 * sizeof(param_name_index_struct)));
+        return RT_ERROR;
+    }
+
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            name_index[n].hash = name_hash(ls[li].par_list_add[i].name);
+            name_index[n].list = li;
+            name_index[n].index = i;
+            n++;
+        }
+    }
+    qsort(name_index, n, sizeof(param_name_index_struct), name_index_cmp);
+
+    //重名的参数只能找到先添加的那个
+    for (uint32_t i = 1; i < n; i++)
+    {
+        param_list *a = &ls[name_index[i - 1].list].par_list_add[name_index[i - 1].index];
+        param_list *b = &ls[name_index[i].list].par_list_add[name_index[i].index];
+        if (name_index[i - 1].hash == name_index[i].hash && a->name != RT_NULL && b->name != RT_NULL &&
+            !strcmp(a->name, b->name))
+        {
+            LOG_W("param name is duplicated: %s", b->name);
+        }
+    }
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  find_param_by_name
+  * @note   二分查找哈希相同的位置, 再比较名称
+  * @param  *name: 参数名称
+  * @retval 找到的索引项, 没有返回RT_NULL
+  */
+static param_name_index_struct *find_param_by_name(const char *name)
+{
+    param_name_index_struct *found = RT_NULL;
+    uint32_t hash, lo = 0, hi = param_header.cnt.u32;
+    uint32_t start = stats_clock();
+
+    if (name == RT_NULL || uparam_build_name_index() != RT_EOK)
+    {
+        return RT_NULL;
+    }
+    hash = name_hash(name);
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (name_index[mid].hash < hash)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for (; lo < param_header.cnt.u32 && name_index[lo].hash == hash; lo++)
+    {
+        param_list *pa = &ls[name_index[lo].list].par_list_add[name_index[lo].index];
+        if (pa->name != RT_NULL && !strcmp(pa->name, name))
+        {
+            found = &name_index[lo];
+            break;
+        }
+    }
+    stats_time(&stats.lookup, start);
+    return found;
+}
+
+/**
+  * @brief  uparam_find
+  * @note   按名称查找参数
+  * @param  *name: 参数名称
+  * @retval 参数, 没有返回RT_NULL
+  */
+param_list *uparam_find(const char *name)
+{
+    param_name_index_struct *found = find_param_by_name(name);
+
+    if (found == RT_NULL)
+    {
+        return RT_NULL;
+    }
+    return &ls[found->list].par_list_add[found->index];
+}
+
+/**
+  * @brief  param_by_name
+  * @note   按名称查找参数, 同时返回所在参数表和序号
+  * @retval 参数, 没有返回RT_NULL
+  */
+static param_list *param_by_name(const char *name, param_name_index_struct **found)
+{
+    *found = find_param_by_name(name);
+    if (*found == RT_NULL)
+    {
+        return RT_NULL;
+    }
+    return &ls[(*found)->list].par_list_add[(*found)->index];
+}
+
+/**
+  * @brief  param_store
+  * @note   写入参数并标记为已修改, 长度不足参数长度时剩余部分填0
+  * @param  len: value的长度, 不能超过参数长度
+  * @retval None
+  */
+static void param_store(param_name_index_struct *found, const void *value, uint16_t len)
+{
+    param_list *pa = &ls[found->list].par_list_add[found->index];
+
+    param_lock();
+    seq_begin();
+    memcpy(pa->address, value, len);
+    memset((uint8_t *)pa->address + len, 0, pa->size - len);
+    seq_end();
+    ls[found->list].dirty[found->index / 8] |= 1 << (found->index % 8);
+    param_unlock();
+    notify_mark(found->list, found->index);
+    notify_request();
+}
+
+/**
+  * @brief  param_load
+  * @note   读出参数, 和写者同时访问时重新读取, 保证读到的是完整的值
+  * @retval None
+  */
+static void param_load(param_list *pa, void *value)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = uparam_read_begin();
+        memcpy(value, pa->address, pa->size);
+    } while (uparam_read_retry(seq));
+}
+
+/**
+  * @brief  uparam_get
+  * @note   按名称读取参数
+  * @param  *name: 参数名称
+  * @param  *value: 输出
+  * @param  size: 输出长度, 必须和参数长度一致
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 长度不一致
+  */
+rt_err_t uparam_get(const char *name, void *value, uint16_t size)
+{
+    param_list *pa = uparam_find(name);
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->size != size)
+    {
+        return -RT_EINVAL;
+    }
+    param_load(pa, value);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_set
+  * @note   按名称写入参数, 并标记为已修改
+  * @param  *name: 参数名称
+  * @param  *value: 数据
+  * @param  size: 数据长度, 必须和参数长度一致
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 长度不一致
+  */
+rt_err_t uparam_set(const char *name, const void *value, uint16_t size)
+{
+    param_name_index_struct *found;
+    param_list *pa = param_by_name(name, &found);
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->size != size)
+    {
+        return -RT_EINVAL;
+    }
+    param_store(found, value, size);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_get_int
+  * @note   按名称读取'd'/'u'类型的整数, 按类型做符号扩展
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型或者长度不对
+  */
+rt_err_t uparam_get_int(const char *name, int64_t *value)
+{
+    param_list *pa = uparam_find(name);
+    uint64_t raw = 0;
+    uint8_t shift;
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if ((pa->type[0] != 'd' && pa->type[0] != 'u') ||
+        (pa->size != 1 && pa->size != 2 && pa->size != 4 && pa->size != 8))
+    {
+        return -RT_EINVAL;
+    }
+    //按小端读到低位, 再按类型做符号扩展
+    param_load(pa, &raw);
+    shift = 64 - pa->size * 8;
+    if (pa->type[0] == 'd')
+    {
+        *value = (int64_t)(raw << shift) >> shift;
+    }
+    else
+    {
+        *value = (int64_t)raw;
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_set_int
+  * @note   按名称写入'd'/'u'类型的整数, 超出参数类型的范围时不写入
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型不对或者超出范围
+  */
+rt_err_t uparam_set_int(const char *name, int64_t value)
+{
+    param_name_index_struct *found;
+    param_list *pa = param_by_name(name, &found);
+    int64_t min, max;
+    uint8_t buf[8];
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if ((pa->type[0] != 'd' && pa->type[0] != 'u') ||
+        (pa->size != 1 && pa->size != 2 && pa->size != 4 && pa->size != 8))
+    {
+        return -RT_EINVAL;
+    }
+    if (pa->size < 8)
+    {
+        if (pa->type[0] == 'd')
+        {
+            max = ((int64_t)1 << (pa->size * 8 - 1)) - 1;
+            min = -max - 1;
+        }
+        else
+        {
+            max = ((int64_t)1 << (pa->size * 8)) - 1;
+            min = 0;
+        }
+        if (value < min || value > max)
+        {
+            return -RT_EINVAL;
+        }
+    }
+    else if (pa->type[0] == 'u' && value < 0)
+    {
+        return -RT_EINVAL;
+    }
+
+    //按小端截断到参数长度
+    for (int i = 0; i < pa->size; i++)
+    {
+        buf[i] = (uint8_t)((uint64_t)value >> (i * 8));
+    }
+    param_store(found, buf, pa->size);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_get_float
+  * @note   按名称读取'f'类型的float或者double
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型或者长度不对
+  */
+rt_err_t uparam_get_float(const char *name, double *value)
+{
+    param_list *pa = uparam_find(name);
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->type[0] == 'f' && pa->size == sizeof(float))
+    {
+        float value_f;
+        param_load(pa, &value_f);
+        *value = value_f;
+    }
+    else if (pa->type[0] == 'f' && pa->size == sizeof(double))
+    {
+        param_load(pa, value);
+    }
+    else
+    {
+        return -RT_EINVAL;
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_set_float
+  * @note   按名称写入'f'类型的float或者double
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型或者长度不对
+  */
+rt_err_t uparam_set_float(const char *name, double value)
+{
+    param_name_index_struct *found;
+    param_list *pa = param_by_name(name, &found);
+    float value_f = (float)value;
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->type[0] == 'f' && pa->size == sizeof(float))
+    {
+        param_store(found, &value_f, sizeof(float));
+    }
+    else if (pa->type[0] == 'f' && pa->size == sizeof(double))
+    {
+        param_store(found, &value, sizeof(double));
+    }
+    else
+    {
+        return -RT_EINVAL;
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_get_str
+  * @note   按名称读取's'类型的字符串, 输出总是以0结尾
+  * @param  size: 输出缓冲大小, 要能放下参数长度加结尾的0
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型不对或者缓冲太小
+  */
+rt_err_t uparam_get_str(const char *name, char *buf, uint16_t size)
+{
+    param_list *pa = uparam_find(name);
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->type[0] != 's' || size <= pa->size)
+    {
+        return -RT_EINVAL;
+    }
+    param_load(pa, buf);
+    buf[pa->size] = '\0';
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_set_str
+  * @note   按名称写入's'类型的字符串, 和 par set 一样长度可以等于参数长度(不带结尾的0), 剩余部分填0
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 类型不对或者太长
+  */
+rt_err_t uparam_set_str(const char *name, const char *str)
+{
+    param_name_index_struct *found;
+    param_list *pa = param_by_name(name, &found);
+    size_t len = strlen(str);
+
+    if (pa == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    if (pa->type[0] != 's' || len > pa->size)
+    {
+        return -RT_EINVAL;
+    }
+    param_store(found, str, len);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_clear_dirty
+  * @note   保存后清除当前存储区的修改标记
+  * @retval None
+  */
+static void uparam_clear_dirty(void)
+{
+    for (int li = 0; li < param_index; li++)
+    {
+        if (!IN_STORE(li))
+        {
+            continue;
+        }
+        uint16_t bit_num = UPARAM_BIT_BYTES(ls[li].par_list_size);
+        memset(FLUSH_DIRTY(li), 0, bit_num);
+    }
+}
+
+/* CRC-8 多项式0x07 */
+static const uint8_t crc8_table[256] =
+    {
+        0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+        0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+        0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+        0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+        0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+        0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+        0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+        0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+        0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+        0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+        0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+        0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+        0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+        0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+        0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+        0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3,
+    };
+
+/* CRC-32 多项式0xEDB88320(反射), 和zlib一致; 多表时第k张表是前一张再移8位的结果 */
+static const uint32_t crc32_table[UPARAM_CRC32_SLICES][256] =
+    {
+        {
+            0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+            0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+            0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+            0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+            0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+            0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+            0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+            0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+            0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+            0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+            0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+            0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+            0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+            0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+            0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+            0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+            0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+            0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+            0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+            0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+            0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+            0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+            0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+            0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+            0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+            0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+            0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+            0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+            0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+            0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+            0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+            0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
+        },
+#if UPARAM_CRC32_SLICES == 4
+        {
+            0x00000000, 0x191B3141, 0x32366282, 0x2B2D53C3, 0x646CC504, 0x7D77F445, 0x565AA786, 0x4F4196C7,
+            0xC8D98A08, 0xD1C2BB49, 0xFAEFE88A, 0xE3F4D9CB, 0xACB54F0C, 0xB5AE7E4D, 0x9E832D8E, 0x87981CCF,
+            0x4AC21251, 0x53D92310, 0x78F470D3, 0x61EF4192, 0x2EAED755, 0x37B5E614, 0x1C98B5D7, 0x05838496,
+            0x821B9859, 0x9B00A918, 0xB02DFADB, 0xA936CB9A, 0xE6775D5D, 0xFF6C6C1C, 0xD4413FDF, 0xCD5A0E9E,
+            0x958424A2, 0x8C9F15E3, 0xA7B24620, 0xBEA97761, 0xF1E8E1A6, 0xE8F3D0E7, 0xC3DE8324, 0xDAC5B265,
+            0x5D5DAEAA, 0x44469FEB, 0x6F6BCC28, 0x7670FD69, 0x39316BAE, 0x202A5AEF, 0x0B07092C, 0x121C386D,
+            0xDF4636F3, 0xC65D07B2, 0xED705471, 0xF46B6530, 0xBB2AF3F7, 0xA231C2B6, 0x891C9175, 0x9007A034,
+            0x179FBCFB, 0x0E848DBA, 0x25A9DE79, 0x3CB2EF38, 0x73F379FF, 0x6AE848BE, 0x41C51B7D, 0x58DE2A3C,
+            0xF0794F05, 0xE9627E44, 0xC24F2D87, 0xDB541CC6, 0x94158A01, 0x8D0EBB40, 0xA623E883, 0xBF38D9C2,
+            0x38A0C50D, 0x21BBF44C, 0x0A96A78F, 0x138D96CE, 0x5CCC0009, 0x45D73148, 0x6EFA628B, 0x77E153CA,
+            0xBABB5D54, 0xA3A06C15, 0x888D3FD6, 0x91960E97, 0xDED79850, 0xC7CCA911, 0xECE1FAD2, 0xF5FACB93,
+            0x7262D75C, 0x6B79E61D, 0x4054B5DE, 0x594F849F, 0x160E1258, 0x0F152319, 0x243870DA, 0x3D23419B,
+            0x65FD6BA7, 0x7CE65AE6, 0x57CB0925, 0x4ED03864, 0x0191AEA3, 0x188A9FE2, 0x33A7CC21, 0x2ABCFD60,
+            0xAD24E1AF, 0xB43FD0EE, 0x9F12832D, 0x8609B26C, 0xC94824AB, 0xD05315EA, 0xFB7E4629, 0xE2657768,
+            0x2F3F79F6, 0x362448B7, 0x1D091B74, 0x04122A35, 0x4B53BCF2, 0x52488DB3, 0x7965DE70, 0x607EEF31,
+            0xE7E6F3FE, 0xFEFDC2BF, 0xD5D0917C, 0xCCCBA03D, 0x838A36FA, 0x9A9107BB, 0xB1BC5478, 0xA8A76539,
+            0x3B83984B, 0x2298A90A, 0x09B5FAC9, 0x10AECB88, 0x5FEF5D4F, 0x46F46C0E, 0x6DD93FCD, 0x74C20E8C,
+            0xF35A1243, 0xEA412302, 0xC16C70C1, 0xD8774180, 0x9736D747, 0x8E2DE606, 0xA500B5C5, 0xBC1B8484,
+            0x71418A1A, 0x685ABB5B, 0x4377E898, 0x5A6CD9D9, 0x152D4F1E, 0x0C367E5F, 0x271B2D9C, 0x3E001CDD,
+            0xB9980012, 0xA0833153, 0x8BAE6290, 0x92B553D1, 0xDDF4C516, 0xC4EFF457, 0xEFC2A794, 0xF6D996D5,
+            0xAE07BCE9, 0xB71C8DA8, 0x9C31DE6B, 0x852AEF2A, 0xCA6B79ED, 0xD37048AC, 0xF85D1B6F, 0xE1462A2E,
+            0x66DE36E1, 0x7FC507A0, 0x54E85463, 0x4DF36522, 0x02B2F3E5, 0x1BA9C2A4, 0x30849167, 0x299FA026,
+            0xE4C5AEB8, 0xFDDE9FF9, 0xD6F3CC3A, 0xCFE8FD7B, 0x80A96BBC, 0x99B25AFD, 0xB29F093E, 0xAB84387F,
+            0x2C1C24B0, 0x350715F1, 0x1E2A4632, 0x07317773, 0x4870E1B4, 0x516BD0F5, 0x7A468336, 0x635DB277,
+            0xCBFAD74E, 0xD2E1E60F, 0xF9CCB5CC, 0xE0D7848D, 0xAF96124A, 0xB68D230B, 0x9DA070C8, 0x84BB4189,
+            0x03235D46, 0x1A386C07, 0x31153FC4, 0x280E0E85, 0x674F9842, 0x7E54A903, 0x5579FAC0, 0x4C62CB81,
+            0x8138C51F, 0x9823F45E, 0xB30EA79D, 0xAA1596DC, 0xE554001B, 0xFC4F315A, 0xD7626299, 0xCE7953D8,
+            0x49E14F17, 0x50FA7E56, 0x7BD72D95, 0x62CC1CD4, 0x2D8D8A13, 0x3496BB52, 0x1FBBE891, 0x06A0D9D0,
+            0x5E7EF3EC, 0x4765C2AD, 0x6C48916E, 0x7553A02F, 0x3A1236E8, 0x230907A9, 0x0824546A, 0x113F652B,
+            0x96A779E4, 0x8FBC48A5, 0xA4911B66, 0xBD8A2A27, 0xF2CBBCE0, 0xEBD08DA1, 0xC0FDDE62, 0xD9E6EF23,
+            0x14BCE1BD, 0x0DA7D0FC, 0x268A833F, 0x3F91B27E, 0x70D024B9, 0x69CB15F8, 0x42E6463B, 0x5BFD777A,
+            0xDC656BB5, 0xC57E5AF4, 0xEE530937, 0xF7483876, 0xB809AEB1, 0xA1129FF0, 0x8A3FCC33, 0x9324FD72,
+        },
+        {
+            0x00000000, 0x01C26A37, 0x0384D46E, 0x0246BE59, 0x0709A8DC, 0x06CBC2EB, 0x048D7CB2, 0x054F1685,
+            0x0E1351B8, 0x0FD13B8F, 0x0D9785D6, 0x0C55EFE1, 0x091AF964, 0x08D89353, 0x0A9E2D0A, 0x0B5C473D,
+            0x1C26A370, 0x1DE4C947, 0x1FA2771E, 0x1E601D29, 0x1B2F0BAC, 0x1AED619B, 0x18ABDFC2, 0x1969B5F5,
+            0x1235F2C8, 0x13F798FF, 0x11B126A6, 0x10734C91, 0x153C5A14, 0x14FE3023, 0x16B88E7A, 0x177AE44D,
+            0x384D46E0, 0x398F2CD7, 0x3BC9928E, 0x3A0BF8B9, 0x3F44EE3C, 0x3E86840B, 0x3CC03A52, 0x3D025065,
+            0x365E1758, 0x379C7D6F, 0x35DAC336, 0x3418A901, 0x3157BF84, 0x3095D5B3, 0x32D36BEA, 0x331101DD,
+            0x246BE590, 0x25A98FA7, 0x27EF31FE, 0x262D5BC9, 0x23624D4C, 0x22A0277B, 0x20E69922, 0x2124F315,
+            0x2A78B428, 0x2BBADE1F, 0x29FC6046, 0x283E0A71, 0x2D711CF4, 0x2CB376C3, 0x2EF5C89A, 0x2F37A2AD,
+            0x709A8DC0, 0x7158E7F7, 0x731E59AE, 0x72DC3399, 0x7793251C, 0x76514F2B, 0x7417F172, 0x75D59B45,
+            0x7E89DC78, 0x7F4BB64F, 0x7D0D0816, 0x7CCF6221, 0x798074A4, 0x78421E93, 0x7A04A0CA, 0x7BC6CAFD,
+            0x6CBC2EB0, 0x6D7E4487, 0x6F38FADE, 0x6EFA90E9, 0x6BB5866C, 0x6A77EC5B, 0x68315202, 0x69F33835,
+            0x62AF7F08, 0x636D153F, 0x612BAB66, 0x60E9C151, 0x65A6D7D4, 0x6464BDE3, 0x662203BA, 0x67E0698D,
+            0x48D7CB20, 0x4915A117, 0x4B531F4E, 0x4A917579, 0x4FDE63FC, 0x4E1C09CB, 0x4C5AB792, 0x4D98DDA5,
+            0x46C49A98, 0x4706F0AF, 0x45404EF6, 0x448224C1, 0x41CD3244, 0x400F5873, 0x4249E62A, 0x438B8C1D,
+            0x54F16850, 0x55330267, 0x5775BC3E, 0x56B7D609, 0x53F8C08C, 0x523AAABB, 0x507C14E2, 0x51BE7ED5,
+            0x5AE239E8, 0x5B2053DF, 0x5966ED86, 0x58A487B1, 0x5DEB9134, 0x5C29FB03, 0x5E6F455A, 0x5FAD2F6D,
+            0xE1351B80, 0xE0F771B7, 0xE2B1CFEE, 0xE373A5D9, 0xE63CB35C, 0xE7FED96B, 0xE5B86732, 0xE47A0D05,
+            0xEF264A38, 0xEEE4200F, 0xECA29E56, 0xED60F461, 0xE82FE2E4, 0xE9ED88D3, 0xEBAB368A, 0xEA695CBD,
+            0xFD13B8F0, 0xFCD1D2C7, 0xFE976C9E, 0xFF5506A9, 0xFA1A102C, 0xFBD87A1B, 0xF99EC442, 0xF85CAE75,
+            0xF300E948, 0xF2C2837F, 0xF0843D26, 0xF1465711, 0xF4094194, 0xF5CB2BA3, 0xF78D95FA, 0xF64FFFCD,
+            0xD9785D60, 0xD8BA3757, 0xDAFC890E, 0xDB3EE339, 0xDE71F5BC, 0xDFB39F8B, 0xDDF521D2, 0xDC374BE5,
+            0xD76B0CD8, 0xD6A966EF, 0xD4EFD8B6, 0xD52DB281, 0xD062A404, 0xD1A0CE33, 0xD3E6706A, 0xD2241A5D,
+            0xC55EFE10, 0xC49C9427, 0xC6DA2A7E, 0xC7184049, 0xC25756CC, 0xC3953CFB, 0xC1D382A2, 0xC011E895,
+            0xCB4DAFA8, 0xCA8FC59F, 0xC8C97BC6, 0xC90B11F1, 0xCC440774, 0xCD866D43, 0xCFC0D31A, 0xCE02B92D,
+            0x91AF9640, 0x906DFC77, 0x922B422E, 0x93E92819, 0x96A63E9C, 0x976454AB, 0x9522EAF2, 0x94E080C5,
+            0x9FBCC7F8, 0x9E7EADCF, 0x9C381396, 0x9DFA79A1, 0x98B56F24, 0x99770513, 0x9B31BB4A, 0x9AF3D17D,
+            0x8D893530, 0x8C4B5F07, 0x8E0DE15E, 0x8FCF8B69, 0x8A809DEC, 0x8B42F7DB, 0x89044982, 0x88C623B5,
+            0x839A6488, 0x82580EBF, 0x801EB0E6, 0x81DCDAD1, 0x8493CC54, 0x8551A663, 0x8717183A, 0x86D5720D,
+            0xA9E2D0A0, 0xA820BA97, 0xAA6604CE, 0xABA46EF9, 0xAEEB787C, 0xAF29124B, 0xAD6FAC12, 0xACADC625,
+            0xA7F18118, 0xA633EB2F, 0xA4755576, 0xA5B73F41, 0xA0F829C4, 0xA13A43F3, 0xA37CFDAA, 0xA2BE979D,
+            0xB5C473D0, 0xB40619E7, 0xB640A7BE, 0xB782CD89, 0xB2CDDB0C, 0xB30FB13B, 0xB1490F62, 0xB08B6555,
+            0xBBD72268, 0xBA15485F, 0xB853F606, 0xB9919C31, 0xBCDE8AB4, 0xBD1CE083, 0xBF5A5EDA, 0xBE9834ED,
+        },
+        {
+            0x00000000, 0xB8BC6765, 0xAA09C88B, 0x12B5AFEE, 0x8F629757, 0x37DEF032, 0x256B5FDC, 0x9DD738B9,
+            0xC5B428EF, 0x7D084F8A, 0x6FBDE064, 0xD7018701, 0x4AD6BFB8, 0xF26AD8DD, 0xE0DF7733, 0x58631056,
+            0x5019579F, 0xE8A530FA, 0xFA109F14, 0x42ACF871, 0xDF7BC0C8, 0x67C7A7AD, 0x75720843, 0xCDCE6F26,
+            0x95AD7F70, 0x2D111815, 0x3FA4B7FB, 0x8718D09E, 0x1ACFE827, 0xA2738F42, 0xB0C620AC, 0x087A47C9,
+            0xA032AF3E, 0x188EC85B, 0x0A3B67B5, 0xB28700D0, 0x2F503869, 0x97EC5F0C, 0x8559F0E2, 0x3DE59787,
+            0x658687D1, 0xDD3AE0B4, 0xCF8F4F5A, 0x7733283F, 0xEAE41086, 0x525877E3, 0x40EDD80D, 0xF851BF68,
+            0xF02BF8A1, 0x48979FC4, 0x5A22302A, 0xE29E574F, 0x7F496FF6, 0xC7F50893, 0xD540A77D, 0x6DFCC018,
+            0x359FD04E, 0x8D23B72B, 0x9F9618C5, 0x272A7FA0, 0xBAFD4719, 0x0241207C, 0x10F48F92, 0xA848E8F7,
+            0x9B14583D, 0x23A83F58, 0x311D90B6, 0x89A1F7D3, 0x1476CF6A, 0xACCAA80F, 0xBE7F07E1, 0x06C36084,
+            0x5EA070D2, 0xE61C17B7, 0xF4A9B859, 0x4C15DF3C, 0xD1C2E785, 0x697E80E0, 0x7BCB2F0E, 0xC377486B,
+            0xCB0D0FA2, 0x73B168C7, 0x6104C729, 0xD9B8A04C, 0x446F98F5, 0xFCD3FF90, 0xEE66507E, 0x56DA371B,
+            0x0EB9274D, 0xB6054028, 0xA4B0EFC6, 0x1C0C88A3, 0x81DBB01A, 0x3967D77F, 0x2BD27891, 0x936E1FF4,
+            0x3B26F703, 0x839A9066, 0x912F3F88, 0x299358ED, 0xB4446054, 0x0CF80731, 0x1E4DA8DF, 0xA6F1CFBA,
+            0xFE92DFEC, 0x462EB889, 0x549B1767, 0xEC277002, 0x71F048BB, 0xC94C2FDE, 0xDBF98030, 0x6345E755,
+            0x6B3FA09C, 0xD383C7F9, 0xC1366817, 0x798A0F72, 0xE45D37CB, 0x5CE150AE, 0x4E54FF40, 0xF6E89825,
+            0xAE8B8873, 0x1637EF16, 0x048240F8, 0xBC3E279D, 0x21E91F24, 0x99557841, 0x8BE0D7AF, 0x335CB0CA,
+            0xED59B63B, 0x55E5D15E, 0x47507EB0, 0xFFEC19D5, 0x623B216C, 0xDA874609, 0xC832E9E7, 0x708E8E82,
+            0x28ED9ED4, 0x9051F9B1, 0x82E4565F, 0x3A58313A, 0xA78F0983, 0x1F336EE6, 0x0D86C108, 0xB53AA66D,
+            0xBD40E1A4, 0x05FC86C1, 0x1749292F, 0xAFF54E4A, 0x322276F3, 0x8A9E1196, 0x982BBE78, 0x2097D91D,
+            0x78F4C94B, 0xC048AE2E, 0xD2FD01C0, 0x6A4166A5, 0xF7965E1C, 0x4F2A3979, 0x5D9F9697, 0xE523F1F2,
+            0x4D6B1905, 0xF5D77E60, 0xE762D18E, 0x5FDEB6EB, 0xC2098E52, 0x7AB5E937, 0x680046D9, 0xD0BC21BC,
+            0x88DF31EA, 0x3063568F, 0x22D6F961, 0x9A6A9E04, 0x07BDA6BD, 0xBF01C1D8, 0xADB46E36, 0x15080953,
+            0x1D724E9A, 0xA5CE29FF, 0xB77B8611, 0x0FC7E174, 0x9210D9CD, 0x2AACBEA8, 0x38191146, 0x80A57623,
+            0xD8C66675, 0x607A0110, 0x72CFAEFE, 0xCA73C99B, 0x57A4F122, 0xEF189647, 0xFDAD39A9, 0x45115ECC,
+            0x764DEE06, 0xCEF18963, 0xDC44268D, 0x64F841E8, 0xF92F7951, 0x41931E34, 0x5326B1DA, 0xEB9AD6BF,
+            0xB3F9C6E9, 0x0B45A18C, 0x19F00E62, 0xA14C6907, 0x3C9B51BE, 0x842736DB, 0x96929935, 0x2E2EFE50,
+            0x2654B999, 0x9EE8DEFC, 0x8C5D7112, 0x34E11677, 0xA9362ECE, 0x118A49AB, 0x033FE645, 0xBB838120,
+            0xE3E09176, 0x5B5CF613, 0x49E959FD, 0xF1553E98, 0x6C820621, 0xD43E6144, 0xC68BCEAA, 0x7E37A9CF,
+            0xD67F4138, 0x6EC3265D, 0x7C7689B3, 0xC4CAEED6, 0x591DD66F, 0xE1A1B10A, 0xF3141EE4, 0x4BA87981,
+            0x13CB69D7, 0xAB770EB2, 0xB9C2A15C, 0x017EC639, 0x9CA9FE80, 0x241599E5, 0x36A0360B, 0x8E1C516E,
+            0x866616A7, 0x3EDA71C2, 0x2C6FDE2C, 0x94D3B949, 0x090481F0, 0xB1B8E695, 0xA30D497B, 0x1BB12E1E,
+            0x43D23E48, 0xFB6E592D, 0xE9DBF6C3, 0x516791A6, 0xCCB0A91F, 0x740CCE7A, 0x66B96194, 0xDE0506F1,
+        },
+#endif
+    };
+
+/**
+  * @brief  cal_crc
+  * @note   计算记录的CRC-8, 查表
+  * @param  start: 起始值
+  * @param  *buff: 
+  * @param  size: 
+  * @retval 
+  */
+static uint8_t cal_crc(uint8_t start, uint8_t *buff, uint16_t size)
+{
+    uint8_t check = start;
+    for (int i = 0; i < size; i++)
+    {
+        check = crc8_table[check ^ buff[i]];
+    }
+    return check;
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  cal_crc_v0
+  * @note   版本0格式的异或校验, 只在加载旧镜像时使用
+  * @retval 
+  */
+static uint8_t cal_crc_v0(uint8_t start, uint8_t *buff, uint16_t size)
+{
+    uint8_t check = start;
+    for (int i = 0; i < size; i++)
+    {
+        check ^= buff[i];
+    }
+    return check;
+}
+#endif
+
+/**
+  * @brief  uparam_crc32
+  * @note   计算CRC-32, 可以分段连续计算, 第一段传入0.
+  *         4张表时先逐字节处理到4字节对齐, 再每次读一个字查表
+  * @param  crc: 上一段的结果
+  * @param  *buf: 数据
+  * @param  size: 长度
+  * @retval CRC-32
+  */
+uint32_t uparam_crc32(uint32_t crc, const void *buf, uint32_t size)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+
+    crc = ~crc;
+#if UPARAM_CRC32_SLICES == 4
+    while (size > 0 && ((rt_ubase_t)p & 3) != 0)
+    {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    while (size >= 4)
+    {
+        //按小端取字, 和逐字节处理的顺序一致
+        crc ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        crc = crc32_table[3][crc & 0xFF] ^ crc32_table[2][(crc >> 8) & 0xFF] ^
+              crc32_table[1][(crc >> 16) & 0xFF] ^ crc32_table[0][crc >> 24];
+        p += 4;
+        size -= 4;
+    }
+#endif
+    while (size > 0)
+    {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    return ~crc;
+}
+
+/**
+  * @brief  reader_peek
+  * @note   保证缓冲里有连续的size字节可用, 不够时把剩余数据移到缓冲开头再从flash补充
+  * @param  *r: 读取器
+  * @param  size: 需要的长度, 不能超过缓冲大小
+  * @retval 数据指针, 失败返回RT_NULL
+  */
+static uint8_t *reader_peek(param_reader_struct *r, uint32_t size)
+{
+    if (r->len - r->pos >= size)
+    {
+        return r->buf + r->pos;
+    }
+    if (size > r->buf_size || r->offset + size - (r->len - r->pos) > r->end)
+    {
+        return RT_NULL;
+    }
+
+    //剩余数据移到开头, 一次尽量读满缓冲
+    memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+
+    uint32_t rsize = r->buf_size - r->len;
+    if (rsize > r->end - r->offset)
+    {
+        rsize = r->end - r->offset;
+    }
+    if (flash_read(r->part, r->offset, r->buf + r->len, rsize) != rsize)
+    {
+        LOG_E("Uparam read failed! offset: %d, size: %d", r->offset, rsize);
+        return RT_NULL;
+    }
+    r->offset += rsize;
+    r->len += rsize;
+    r->read_calls++;
+
+    return r->buf;
+}
+
+/**
+  * @brief  reader_seek
+  * @note   丢弃缓冲, 下一次从offset开始读取
+  * @retval None
+  */
+static void reader_seek(param_reader_struct *r, uint32_t offset)
+{
+    r->offset = offset;
+    r->len = 0;
+    r->pos = 0;
+}
+
+/**
+  * @brief  reader_stream
+  * @note   按缓冲大小分块读取比缓冲大的数据, 边读边累加校验, 不需要整条记录的缓冲.
+  *         dst不为空时每块在写者临界区里复制, 有变化时置位r->changed, 写入参数内存要用 param_restore 保证整个参数一次写入
+  * @param  *r: 读取器
+  * @param  *dst: 参数内存, RT_NULL只计算校验
+  * @param  size: 长度
+  * @param  *crc32: 累加的CRC-32, 不需要时为RT_NULL
+  * @param  *crc8: 累加的CRC-8, 不需要时为RT_NULL
+  * @retval RT_EOK 成功
+  */
+static rt_err_t reader_stream(param_reader_struct *r, uint8_t *dst, uint32_t size, uint32_t *crc32, uint8_t *crc8)
+{
+    uint8_t *data;
+
+    while (size > 0)
+    {
+        //缓冲里有数据时先用完, 空了再整块读
+        uint32_t n = r->len - r->pos;
+        if (n == 0)
+        {
+            n = r->buf_size;
+        }
+        if (n > size)
+        {
+            n = size;
+        }
+        if ((data = reader_peek(r, n)) == RT_NULL)
+        {
+            return RT_ERROR;
+        }
+        if (crc32 != RT_NULL)
+        {
+            *crc32 = uparam_crc32(*crc32, data, n);
+        }
+        if (crc8 != RT_NULL)
+        {
+            *crc8 = cal_crc(*crc8, data, n);
+        }
+        if (dst != RT_NULL)
+        {
+            r->changed |= param_write(dst, data, n);
+            dst += n;
+        }
+        r->pos += n;
+        size -= n;
+    }
+    return RT_EOK;
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  reader_rewind
+  * @note   回到offset重新读取, offset还在缓冲里时不用再读flash
+  * @retval None
+  */
+static void reader_rewind(param_reader_struct *r, uint32_t offset)
+{
+    if (offset >= r->offset - r->len && offset <= r->offset)
+    {
+        r->pos = offset - (r->offset - r->len);
+        return;
+    }
+    reader_seek(r, offset);
+}
+
+/**
+  * @brief  rle_data_end
+  * @note   压缩数据段可能的结束位置, 头部里只有解压后的长度, 最坏情况下每128字节多1个控制字节
+  * @param  offset: 数据段在分区里的位置
+  * @param  size: 解压后的长度
+  * @retval 结束位置, 不超过分区长度
+  */
+static uint32_t rle_data_end(uint32_t offset, uint32_t size)
+{
+    uint64_t end = offset + (uint64_t)size + (size + UPARAM_RLE_LITERAL_MAX - 1) / UPARAM_RLE_LITERAL_MAX;
+
+    return (end < store->len) ? (uint32_t)end : store->len;
+}
+
+/**
+  * @brief  rle_read
+  * @note   解压size字节, 边解压边累加CRC-32. dst不为空时每段在写者临界区里写入, 有变化时置位读取器的changed,
+  *         写入参数内存要用 param_restore 保证整个参数一次写入
+  * @param  *d: 解码器
+  * @param  *dst: 参数内存, RT_NULL只计算校验
+  * @param  size: 解压后的长度
+  * @param  *crc: 累加的CRC-32
+  * @retval RT_EOK 成功
+  */
+static rt_err_t rle_read(param_rle_decoder_struct *d, uint8_t *dst, uint32_t size, uint32_t *crc)
+{
+    param_reader_struct *r = d->r;
+    uint8_t *data;
+
+    while (size > 0)
+    {
+        if (d->left == 0)
+        {
+            if ((data = reader_peek(r, 1)) == RT_NULL)
+            {
+                return RT_ERROR;
+            }
+            d->repeat = (data[0] & 0x80) != 0;
+            d->left = d->repeat ? (data[0] & 0x7F) + UPARAM_RLE_RUN_MIN : data[0] + 1;
+            r->pos++;
+            if (d->repeat)
+            {
+                if ((data = reader_peek(r, 1)) == RT_NULL)
+                {
+                    return RT_ERROR;
+                }
+                d->value = data[0];
+                r->pos++;
+            }
+        }
+
+        uint32_t n = (d->left < size) ? d->left : size;
+        if (d->repeat)
+        {
+            if (dst != RT_NULL)
+            {
+                uint32_t same = 0;
+
+                while (same < n && dst[same] == d->value)
+                {
+                    same++;
+                }
+                if (same < n)
+                {
+                    seq_begin();
+                    memset(dst, d->value, n);
+                    seq_end();
+                    r->changed = 1;
+                }
+                *crc = uparam_crc32(*crc, dst, n);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < n; i++)
+                {
+                    *crc = uparam_crc32(*crc, &d->value, 1);
+                }
+            }
+        }
+        else
+        {
+            //原样的字节先用缓冲里剩下的, 空了再读
+            if (r->len - r->pos == 0)
+            {
+                if ((data = reader_peek(r, (n < r->buf_size) ? n : r->buf_size)) == RT_NULL)
+                {
+                    return RT_ERROR;
+                }
+            }
+            if (n > r->len - r->pos)
+            {
+                n = r->len - r->pos;
+            }
+            data = r->buf + r->pos;
+            *crc = uparam_crc32(*crc, data, n);
+            if (dst != RT_NULL)
+            {
+                r->changed |= param_write(dst, data, n);
+            }
+            r->pos += n;
+        }
+        d->left -= n;
+        size -= n;
+        if (dst != RT_NULL)
+        {
+            dst += n;
+        }
+    }
+    return RT_EOK;
+}
+#endif
+
+/**
+  * @brief  param_stream
+  * @note   从读取器读出size字节到dst, d不为空时解压
+  * @retval RT_EOK 成功
+  */
+static rt_err_t param_stream(param_reader_struct *r, param_rle_decoder_struct *d, uint8_t *dst, uint32_t size)
+{
+#ifndef UPARAM_USING_LOG
+    uint32_t crc = 0;
+
+    if (d != RT_NULL)
+    {
+        return rle_read(d, dst, size, &crc);
+    }
+#endif
+    return reader_stream(r, dst, size, RT_NULL, RT_NULL);
+}
+
+/**
+  * @brief  param_restore
+  * @note   从读取器读出一个参数写入参数内存, 数据必须已经校验过.
+  *         原样数据能放进读缓冲时直接从缓冲复制; 比缓冲大或者压缩的参数先读到临时缓冲,
+  *         再在一个写者临界区里写入. 临时缓冲分配失败时只能分块写入, 读者可能读到一半新一半旧的值.
+  *         没有打开 UPARAM_USING_LOCK 时没有不加锁的读者, 直接分块写入. 参数内容有变化时r->changed为1
+  * @param  *r: 读取器
+  * @param  *d: 解码器, 不压缩时为RT_NULL
+  * @param  *dst: 参数内存
+  * @param  size: 长度
+  * @retval RT_EOK 成功
+  */
+static rt_err_t param_restore(param_reader_struct *r, param_rle_decoder_struct *d, uint8_t *dst, uint32_t size)
+{
+    uint8_t *data;
+
+    r->changed = 0;
+    if (d == RT_NULL && size <= r->buf_size)
+    {
+        if ((data = reader_peek(r, size)) == RT_NULL)
+        {
+            return RT_ERROR;
+        }
+        r->changed = param_write(dst, data, size);
+        r->pos += size;
+        return RT_EOK;
+    }
+#ifdef UPARAM_USING_LOCK
+    data = (size <= sizeof(copy_buf)) ? copy_buf : (uint8_t *)UPARAM_MALLOC(size);
+    if (data != RT_NULL)
+    {
+        rt_err_t ret = param_stream(r, d, data, size);
+
+        if (ret == RT_EOK)
+        {
+            r->changed = param_write(dst, data, size);
+        }
+        if (data != copy_buf)
+        {
+            UPARAM_FREE(data);
+        }
+        return ret;
+    }
+    LOG_W("Uparam malloc copy buffer failed, size: %d", size);
+#endif
+    return param_stream(r, d, dst, size);
+}
+
+/**
+  * @brief  uparam_set_read_buffer
+  * @note   设置加载用的读缓冲, 缓冲能放下整个参数镜像时加载只需要读两次flash(头部和数据)
+  * @param  *buf: 缓冲, RT_NULL则使用内部静态的 UPARAM_READ_BUF_SIZE 字节缓冲
+  * @param  size: 缓冲大小, 比缓冲大的参数分块读取
+  * @retval None
+  */
+void uparam_set_read_buffer(void *buf, uint32_t size)
+{
+    read_buf = (uint8_t *)buf;
+    read_buf_size = (buf != RT_NULL) ? size : 0;
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  store_next
+  * @note   地址索引里从第n项开始, 下一个属于当前存储区的参数
+  * @retval 地址索引的序号, 没有时为 addr_index_num
+  */
+static uint32_t store_next(uint32_t n)
+{
+    while (n < addr_index_num && !IN_STORE(addr_index[n].list))
+    {
+        n++;
+    }
+    return n;
+}
+
+/**
+  * @brief  store_select
+  * @note   切换当前加载和保存的存储区
+  * @retval None
+  */
+static void store_select(uint8_t s)
+{
+    store = &stores[s];
+    par_part = store->part;
+    par_base = store->offset;
+}
+
+/**
+  * @brief  image_read_header
+  * @note   解析镜像头部和CRC槽, 旧版本的头部转换成当前的结构
+  * @param  *data: 头部数据, IMAGE_DATA_OFFSET 字节
+  * @param  *header: 输出的头部
+  * @retval 头部之后数据开始的位置, 头部无效返回0
+  */
+static uint32_t image_read_header(uint8_t *data, param_header_struct *header)
+{
+    memset(header, 0, sizeof(param_header_struct));
+    //版本2到4的头部相同, 版本3开始会压缩
+    if (data[0] == UPARAM_HEADER_MAGIC &&
+        (data[1] == 2 || (data[1] & ~UPARAM_FORMAT_RLE) == 3 || (data[1] & ~UPARAM_FORMAT_RLE) == UPARAM_FORMAT_VERSION))
+    {
+        memcpy(header, data, sizeof(param_header_struct));
+        if (header->crc != uparam_crc32(0, header, sizeof(param_header_struct) - 8))
+        {
+            return 0;
+        }
+        //最后一个写过的槽是最新的镜像CRC
+        store->crc_slots = 0;
+        for (int i = 0; i < UPARAM_CRC_SLOTS; i++)
+        {
+            uint32_t slot;
+
+            memcpy(&slot, data + IMAGE_SLOT_OFFSET + i * IMAGE_SLOT_SIZE, 4);
+            if (slot == 0xFFFFFFFF)
+            {
+                break;
+            }
+            header->image_crc = slot;
+            store->crc_slots = i + 1;
+        }
+        return IMAGE_DATA_OFFSET;
+    }
+    if (data[0] == UPARAM_HEADER_MAGIC && data[1] == 1)
+    {
+        param_header_v1_struct v1;
+
+        memcpy(&v1, data, sizeof(param_header_v1_struct));
+        if (v1.crc != uparam_crc32(0, &v1, sizeof(param_header_v1_struct) - 8))
+        {
+            return 0;
+        }
+        header->header = v1.header;
+        header->version = v1.version;
+        header->cnt.u32 = v1.cnt;
+        header->size.u32 = v1.size;
+        return UPARAM_ALIGN(sizeof(param_header_v1_struct), UPARAM_WRITE_GRAN) + UPARAM_CRC_SLOTS * IMAGE_SLOT_SIZE;
+    }
+    if (data[0] == UPARAM_HEADER_MAGIC_V0)
+    {
+        param_header_v0_struct v0;
+
+        memcpy(&v0, data, sizeof(param_header_v0_struct));
+        uint8_t check = cal_crc_v0(0x55, v0.cnt.u8, 4);
+        check = cal_crc_v0(check, v0.size.u8, 4);
+        if (check != v0.crc)
+        {
+            return 0;
+        }
+        header->header = v0.header;
+        header->cnt.u32 = v0.cnt.u32;
+        header->size.u32 = v0.size.u32;
+        return UPARAM_ALIGN(sizeof(param_header_v0_struct), UPARAM_WRITE_GRAN);
+    }
+    return 0;
+}
+
+/**
+  * @brief  image_find_param
+  * @note   查找flash记录对应的参数, 标记为已读出. 内容有变化时由调用者标记通知
+  * @param  *pa_this: flash里的ID和长度
+  * @param  by_address: 版本3及以前的镜像, pa_this里是参数地址
+  * @param  *list: 参数表序号
+  * @param  *index: 参数在表里的序号
+  * @retval 参数内存, 不存在返回RT_NULL
+  */
+static uint8_t *image_find_param(param_p *pa_this, uint8_t by_address, uint16_t *list, uint16_t *index)
+{
+    //不要直接赋值，先检查一下是否在参数表里面存在，防止数据地址被修改后写入未知地址
+    //参数表换到别的存储区后, 旧存储区里的记录不再读出
+    if (!find_param_by_key(pa_this->id, pa_this->size, by_address, list, index) || !IN_STORE(*list))
+    {
+        //未找到此参数
+        LOG_W("param is not exist, %s: 0x%X ,read size: %d", by_address ? "address" : "id", pa_this->id, pa_this->size);
+        return RT_NULL;
+    }
+
+    //对成功读出的数据标记一下
+    ls[*list].read_valid[*index / 8] |= 1 << (*index % 8);
+
+    return par_addr[PAR_G(*list, *index)];
+}
+
+/**
+  * @brief  image_read_param
+  * @note   把读出的一个参数赋值到内存
+  * @param  *pa_this: flash里的ID和长度
+  * @param  by_address: pa_this里是参数地址
+  * @param  *data: 数据
+  * @retval 1 参数存在, 0 不存在
+  */
+static int image_read_param(param_p *pa_this, uint8_t by_address, uint8_t *data)
+{
+    uint16_t list, index;
+    uint8_t *address = image_find_param(pa_this, by_address, &list, &index);
+
+    if (address == RT_NULL)
+    {
+        return 0;
+    }
+    if (param_write(address, data, pa_this->size))
+    {
+        notify_mark(list, index);
+    }
+
+    return 1;
+}
+
+/**
+  * @brief  image_read_records
+  * @note   读取版本0和1的镜像, 逐条解析 地址+长度+数据+校验 的记录
+  * @param  *r: 读取器, 已经读过头部
+  * @param  *header: 镜像头部
+  * @retval 读取成功的参数个数
+  */
+static uint16_t image_read_records(param_reader_struct *r, param_header_struct *header)
+{
+    uint16_t read_num = 0;
+    param_p pa_this;
+    param_p_v2 rec;
+    uint8_t *data;
+    uint8_t check;
+
+    for (int i = 0; i < header->cnt.u32; i++)
+    {
+        if ((data = reader_peek(r, sizeof(param_p_v2))) == RT_NULL)
+        {
+            LOG_E("Uparam read data failed!");
+            return 0;
+        }
+        memcpy(&rec, data, sizeof(param_p_v2));
+        r->pos += sizeof(param_p_v2);
+        pa_this.id = rec.address;
+        pa_this.size = rec.size;
+
+        //数据加1字节CRC
+        if ((data = reader_peek(r, pa_this.size + 1)) == RT_NULL)
+        {
+            LOG_E("Uparam read data failed!");
+            return 0;
+        }
+        r->pos += pa_this.size + 1;
+
+        //检查CRC
+        check = header->version > 0 ? cal_crc(0x55, data, pa_this.size) : cal_crc_v0(0x55, data, pa_this.size);
+
+        LOG_D("read param address 0x%X, size:%d, crc:%X, calc:%X", pa_this.id, pa_this.size, data[pa_this.size], check);
+
+        if (check != data[pa_this.size])
+        {
+            LOG_E("Uparam check data failed! Index:%d, Address:%X", i, pa_this.id);
+            stats_add(crc_errors, 1);
+            return 0;
+        }
+
+        read_num += image_read_param(&pa_this, 1, data);
+    }
+
+    return read_num;
+}
+
+/**
+  * @brief  image_drop
+  * @note   写入参数内存的过程中失败, 清除当前存储区的读取标记, 初始化时全部复位到默认值
+  * @retval None
+  */
+static void image_drop(void)
+{
+    for (int li = 0; li < param_index; li++)
+    {
+        if (IN_STORE(li))
+        {
+            memset(ls[li].read_valid, 0, UPARAM_BIT_BYTES(ls[li].par_list_size));
+        }
+    }
+}
+
+/**
+  * @brief  image_data_crc
+  * @note   按块读出数据段计算CRC-32, 压缩的数据段边解压边计算, 不写入参数内存
+  * @param  *r: 读取器
+  * @param  offset: 数据段在分区里的位置
+  * @param  size: 解压后的长度
+  * @param  rle: 数据段是否压缩
+  * @param  *crc: 算出的CRC-32
+  * @retval RT_EOK 成功
+  */
+static rt_err_t image_data_crc(param_reader_struct *r, uint32_t offset, uint32_t size, uint8_t rle, uint32_t *crc)
+{
+    param_rle_decoder_struct dec;
+
+    memset(&dec, 0, sizeof(dec));
+    dec.r = r;
+    reader_seek(r, offset);
+    r->end = rle ? rle_data_end(offset, size) : offset + size;
+    *crc = 0;
+    return rle ? rle_read(&dec, RT_NULL, size, crc) : reader_stream(r, RT_NULL, size, crc, RT_NULL);
+}
+
+/**
+  * @brief  image_read_bulk
+  * @note   布局一致时按地址顺序读出数据段. 先按块读取只计算CRC, 校验通过后再按块读出分散复制到每个参数,
+  *         数据段能放进读缓冲时第二遍不再读flash, 否则数据段要从flash读两遍. 压缩的数据段通过读缓冲边解压边复制
+  * @param  *r: 读取器, 解压时使用它的缓冲
+  * @param  *header: 镜像头部
+  * @param  offset: 数据段在分区里的位置
+  * @retval 读取成功的参数个数
+  */
+static uint16_t image_read_bulk(param_reader_struct *r, param_header_struct *header, uint32_t offset)
+{
+    uint32_t size = header->size.u32, crc = 0;
+    uint8_t rle = (header->version & UPARAM_FORMAT_RLE) != 0;
+    param_rle_decoder_struct dec;
+
+    //先只校验, 校验失败时参数内存保持原来的值
+    r->read_calls = 0;
+    if (image_data_crc(r, offset, size, rle, &crc) != RT_EOK)
+    {
+        LOG_E("Uparam read data failed!");
+        return 0;
+    }
+    if (crc != header->image_crc)
+    {
+        LOG_E("Uparam image crc check failed!");
+        stats_add(crc_errors, 1);
+        return 0;
+    }
+
+    reader_rewind(r, offset);
+    memset(&dec, 0, sizeof(dec));
+    dec.r = r;
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        uint32_t g = ADDR_G(n);
+        if (param_restore(r, rle ? &dec : RT_NULL, par_addr[g], par_size[g]) != RT_EOK)
+        {
+            LOG_E("Uparam read data failed!");
+            image_drop();
+            return 0;
+        }
+        //只通知内容有变化的参数
+        if (r->changed)
+        {
+            notify_mark(addr_index[n].list, addr_index[n].index);
+        }
+    }
+
+    for (int li = 0; li < param_index; li++)
+    {
+        if (IN_STORE(li))
+        {
+            memset(ls[li].read_valid, 0xFF, UPARAM_BIT_BYTES(ls[li].par_list_size));
+        }
+    }
+    LOG_D("read param bulk, flash read: %d", r->read_calls);
+
+    return header->cnt.u32;
+}
+
+/**
+  * @brief  image_read_dir
+  * @note   布局不一致时按目录逐条查找参数, 目录和数据段各用一个读取器, 共用读缓冲.
+  *         先校验目录和数据段, 都通过后再读一遍写入参数内存. 比数据缓冲大的参数分块读取
+  * @param  *r: 读取器, 用来分配缓冲
+  * @param  *header: 镜像头部
+  * @param  offset: 目录在分区里的位置
+  * @retval 读取成功的参数个数
+  */
+static uint16_t image_read_dir(param_reader_struct *r, param_header_struct *header, uint32_t offset)
+{
+    param_reader_struct dir, data_r;
+    uint32_t layout = 0, crc = 0;
+    uint16_t read_num = 0;
+    param_p pa_this;
+    param_p_v2 rec;
+    uint8_t *data;
+    //版本2的目录项长度只有1字节
+    uint32_t entry = (header->version < 3) ? sizeof(param_p_v2) : sizeof(param_p);
+    //版本4开始目录里存的是参数ID
+    uint8_t by_address = (header->version & ~UPARAM_FORMAT_RLE) < 4;
+    uint8_t rle = (header->version & UPARAM_FORMAT_RLE) != 0;
+    param_rle_decoder_struct dec;
+
+    //目录用1/4缓冲, 数据至少要能放下最长的参数
+    memset(&dir, 0, sizeof(dir));
+    dir.part = par_part;
+    dir.buf = r->buf;
+    dir.buf_size = r->buf_size / 4;
+    dir.offset = offset;
+    dir.end = offset + header->cnt.u32 * entry;
+    memset(&data_r, 0, sizeof(data_r));
+    data_r.part = par_part;
+    data_r.buf = r->buf + dir.buf_size;
+    data_r.buf_size = r->buf_size - dir.buf_size;
+    data_r.offset = dir.end;
+    data_r.end = dir.end + header->size.u32;
+    //压缩后的长度不在头部里, 解压到参数总长度为止
+    memset(&dec, 0, sizeof(dec));
+    dec.r = &data_r;
+    if (rle)
+    {
+        data_r.end = rle_data_end(dir.end, header->size.u32);
+    }
+
+    //目录和数据段都是连续的, 整段计算CRC
+    if (reader_stream(&dir, RT_NULL, header->cnt.u32 * entry, &layout, RT_NULL) != RT_EOK ||
+        (rle ? rle_read(&dec, RT_NULL, header->size.u32, &crc) : reader_stream(&data_r, RT_NULL, header->size.u32, &crc, RT_NULL)) != RT_EOK)
+    {
+        LOG_E("Uparam read data failed!");
+        return 0;
+    }
+    if (layout != header->layout || crc != header->image_crc)
+    {
+        LOG_E("Uparam image crc check failed!");
+        stats_add(crc_errors, 1);
+        return 0;
+    }
+
+    reader_rewind(&dir, offset);
+    reader_rewind(&data_r, dir.end);
+    memset(&dec, 0, sizeof(dec));
+    dec.r = &data_r;
+    for (int i = 0; i < header->cnt.u32; i++)
+    {
+        if ((data = reader_peek(&dir, entry)) == RT_NULL)
+        {
+            LOG_E("Uparam read directory failed!");
+            image_drop();
+            return 0;
+        }
+        if (entry == sizeof(param_p))
+        {
+            memcpy(&pa_this, data, sizeof(param_p));
+        }
+        else
+        {
+            memcpy(&rec, data, sizeof(param_p_v2));
+            pa_this.id = rec.address;
+            pa_this.size = rec.size;
+        }
+        dir.pos += entry;
+
+        //不在参数表里的参数也要读过去
+        uint16_t list, index;
+        uint8_t *address = image_find_param(&pa_this, by_address, &list, &index);
+        if ((address != RT_NULL ? param_restore(&data_r, rle ? &dec : RT_NULL, address, pa_this.size)
+                                : param_stream(&data_r, rle ? &dec : RT_NULL, RT_NULL, pa_this.size)) != RT_EOK)
+        {
+            LOG_E("Uparam read data failed!");
+            image_drop();
+            return 0;
+        }
+        if (address != RT_NULL && data_r.changed)
+        {
+            notify_mark(list, index);
+        }
+        read_num += (address != RT_NULL);
+    }
+    LOG_D("read param by directory, flash read: %d", dir.read_calls + data_r.read_calls);
+
+    return read_num;
+}
+
+/**
+  * @brief  image_readall
+  * @note   从flash读取所有参数到内存.
+  *         布局指纹和当前参数表一致时整块读入数据段, 否则按目录逐条查找, 旧版本的镜像逐条解析记录
+  * @retval 
+  */
+static uint16_t image_readall()
+{
+    param_header_struct header;
+    uint16_t read_num = 0; //读成功的数量
+    uint8_t *data;
+    param_reader_struct reader;
+    uint32_t data_offset;
+    uint64_t allsize;
+
+    write_protect = 1;
+    store->match = 0;
+    store->version = 0;
+    store->crc_slots = UPARAM_CRC_SLOTS;
+
+    if (uparam_build_index() != RT_EOK)
+    {
+        return 0;
+    }
+
+    memset(&reader, 0, sizeof(reader));
+    reader.part = par_part;
+    reader.buf = (read_buf != RT_NULL) ? read_buf : io_read_buf;
+    reader.buf_size = (read_buf != RT_NULL) ? read_buf_size : sizeof(io_read_buf);
+    //先只读头部, 得到数据长度后再按块读取, 头部按最小写入单位对齐后才是数据
+    reader.end = IMAGE_DATA_OFFSET;
+
+    //read header
+    if ((data = reader_peek(&reader, IMAGE_DATA_OFFSET)) == RT_NULL)
+    {
+        LOG_E("Uparam read header failed!");
+        return 0;
+    }
+
+    //检查header是否有效
+    if ((data_offset = image_read_header(data, &header)) == 0)
+    {
+        LOG_E("Uparam header invalid!");
+        return 0;
+    }
+    reader.pos += data_offset;
+
+    //镜像总长度 header + 每条记录的信息(旧版本还有校验) + 数据
+    allsize = data_offset + (uint64_t)(header.version < 3 ? sizeof(param_p_v2) : sizeof(param_p)) * header.cnt.u32;
+    //压缩的数据段长度要解压后才知道
+    if ((header.version & UPARAM_FORMAT_RLE) == 0)
+    {
+        allsize += header.size.u32;
+    }
+    if (header.version < 2)
+    {
+        allsize += header.cnt.u32;
+    }
+    if (allsize > store->len)
+    {
+        LOG_E("Uparam image size invalid, size: %d", (uint32_t)allsize);
+        return 0;
+    }
+    reader.end = (uint32_t)allsize;
+
+    LOG_D("read param number: %d, version: %d", header.cnt.u32, header.version);
+    if (header.cnt.u32 != store->header.cnt.u32)
+    {
+        LOG_W("param number is changed, the exist is %d", store->header.cnt.u32);
+    }
+
+    if (header.version < 2)
+    {
+        read_num = image_read_records(&reader, &header);
+    }
+    else if ((header.version & ~UPARAM_FORMAT_RLE) == UPARAM_FORMAT_VERSION && header.layout == store->layout &&
+             header.cnt.u32 == store->header.cnt.u32 && header.size.u32 == store->header.size.u32)
+    {
+        read_num = image_read_bulk(&reader, &header, data_offset + header.cnt.u32 * sizeof(param_p));
+        //布局一致, 之后可以只按脏标记保存
+        store->match = (read_num > 0);
+    }
+    else
+    {
+        read_num = image_read_dir(&reader, &header, data_offset);
+    }
+    store->version = header.version;
+    store->crc = header.image_crc;
+    LOG_D("read param success count: %d", read_num);
+
+    return read_num;
+}
+
+#endif
+
+/**
+  * @brief  writer_program
+  * @note   把页缓冲里的数据编程到flash, 长度补0xFF对齐到最小写入单位
+  * @param  *w: 写入器
+  * @retval RT_EOK 成功
+  */
+static rt_err_t writer_program(param_writer_struct *w)
+{
+    uint32_t wsize = UPARAM_ALIGN(w->len, UPARAM_WRITE_GRAN);
+
+    if (wsize == 0)
+    {
+        return RT_EOK;
+    }
+    memset(w->buf + w->len, 0xFF, wsize - w->len);
+    if (flash_write(w->part, w->offset, w->buf, wsize) != wsize)
+    {
+        LOG_E("Uparam write failed! offset: %d, size: %d", w->offset, wsize);
+        return RT_ERROR;
+    }
+    w->offset += wsize;
+    w->len = 0;
+    w->prog_calls++;
+
+    return RT_EOK;
+}
+
+#if !defined(UPARAM_USING_LOG) || !defined(UPARAM_USING_DIRTY_API_ONLY)
+/**
+  * @brief  writer_compare
+  * @note   和flash里的内容比较, 按页读出flash
+  * @param  *w: 写入器
+  * @param  offset: 数据在镜像里的位置
+  * @retval 1 内容不同, 2 不同但只把1写成0(分区允许再编程时, 不同的范围记在diff_start/diff_end), 0 相同, <0 读失败
+  */
+static int writer_compare(param_writer_struct *w, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    int ret = 0;
+
+    while (size > 0)
+    {
+        if (offset < w->offset || offset >= w->offset + w->len)
+        {
+            w->offset = offset - offset % UPARAM_WRITE_PAGE_SIZE;
+            w->len = UPARAM_WRITE_PAGE_SIZE;
+            if (w->len > w->end - w->offset)
+            {
+                w->len = w->end - w->offset;
+            }
+            if (flash_read(w->part, w->offset, w->buf, w->len) != w->len)
+            {
+                return -1;
+            }
+        }
+        uint32_t n = w->offset + w->len - offset;
+        if (n > size)
+        {
+            n = size;
+        }
+        const uint8_t *old = w->buf + (offset - w->offset);
+        if (memcmp(old, data, n) != 0)
+        {
+            if (!w->overwrite)
+            {
+                return 1;
+            }
+            for (uint32_t k = 0; k < n; k++)
+            {
+                if (data[k] & ~old[k])
+                {
+                    return 1;
+                }
+                if (data[k] != old[k])
+                {
+                    //记录不同的范围
+                    if (ret == 0)
+                    {
+                        w->diff_start = offset + k;
+                        ret = 2;
+                    }
+                    w->diff_end = offset + k + 1;
+                }
+            }
+        }
+        offset += n;
+        data += n;
+        size -= n;
+    }
+    return ret;
+}
+
+#endif
+
+/**
+  * @brief  writer_append
+  * @note   把数据拼到页缓冲里, 写满一页(到页边界)编程一次, 地址不连续时先编程已有数据
+  * @param  *w: 写入器
+  * @param  offset: 数据在镜像里的位置
+  * @retval RT_EOK 成功
+  */
+static rt_err_t writer_append(param_writer_struct *w, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    if (w->len > 0 && offset != w->offset + w->len && writer_program(w) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    if (w->len == 0)
+    {
+        w->offset = offset;
+    }
+
+    while (size > 0)
+    {
+        //第一页可能从页中间开始, 之后每次都是整页
+        uint32_t limit = UPARAM_WRITE_PAGE_SIZE - w->offset % UPARAM_WRITE_PAGE_SIZE;
+        uint32_t n = limit - w->len;
+        if (n > size)
+        {
+            n = size;
+        }
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        size -= n;
+
+        if (w->len == limit && writer_program(w) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+    }
+    return RT_EOK;
+}
+
+#ifndef UPARAM_USING_LOG
+static int sector_marked(param_writer_struct *w, uint32_t sector)
+{
+    //超出标记范围的扇区当作需要重写
+    return sector >= UPARAM_MAX_SECTORS || (w->sector_mask[sector / 8] & (1 << (sector % 8)));
+}
+
+static void sector_mark(param_writer_struct *w, uint32_t sector)
+{
+    if (sector < UPARAM_MAX_SECTORS)
+    {
+        w->sector_mask[sector / 8] |= 1 << (sector % 8);
+    }
+}
+
+/**
+  * @brief  overwrite_add
+  * @note   记录一段在原位置再编程的数据, 对齐到最小写入单位, 和上一段相连时合并
+  * @param  *w: 写入器
+  * @param  offset: 数据在镜像里的位置
+  * @param  size: 长度
+  * @retval RT_EOK 成功, RT_ERROR 区间已用完
+  */
+static rt_err_t overwrite_add(param_writer_struct *w, uint32_t offset, uint32_t size)
+{
+    uint32_t start = offset - offset % UPARAM_WRITE_GRAN;
+    uint32_t end = UPARAM_ALIGN(offset + size, UPARAM_WRITE_GRAN);
+    if (w->over_num > 0 && start <= w->over[w->over_num - 1].offset + w->over[w->over_num - 1].size)
+    {
+        param_range_struct *last = &w->over[w->over_num - 1];
+        if (end > last->offset + last->size)
+        {
+            last->size = end - last->offset;
+        }
+        return RT_EOK;
+    }
+    if (w->over_num >= UPARAM_OVERWRITE_MAX)
+    {
+        return RT_ERROR;
+    }
+    w->over[w->over_num].offset = start;
+    w->over[w->over_num].size = end - start;
+    w->over_num++;
+    return RT_EOK;
+}
+
+/**
+  * @brief  overwrite_put
+  * @note   编程时把落在再编程区间里的数据交给页缓冲, 数据按地址顺序到来
+  * @param  *w: 写入器
+  * @param  offset: 数据在镜像里的位置
+  * @retval RT_EOK 成功
+  */
+static rt_err_t overwrite_put(param_writer_struct *w, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    while (w->over_pos < w->over_num && w->over[w->over_pos].offset + w->over[w->over_pos].size <= offset)
+    {
+        w->over_pos++;
+    }
+    for (uint16_t k = w->over_pos; k < w->over_num && w->over[k].offset < offset + size; k++)
+    {
+        uint32_t start = (w->over[k].offset > offset) ? w->over[k].offset : offset;
+        uint32_t end = w->over[k].offset + w->over[k].size;
+        if (end > offset + size)
+        {
+            end = offset + size;
+        }
+        if (writer_append(w, start, data + (start - offset), end - start) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  writer_put
+  * @note   按扇区拆分镜像数据, 根据写入器的工作方式比较、标记或者编程
+  * @param  *w: 写入器
+  * @param  offset: 数据在镜像里的位置
+  * @param  *data: 数据
+  * @param  size: 长度
+  * @retval RT_EOK 成功
+  */
+static rt_err_t writer_put(param_writer_struct *w, uint32_t offset, const void *data, uint32_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (w->mode == UPARAM_WRITER_SIZE)
+    {
+        return RT_EOK;
+    }
+    while (size > 0)
+    {
+        uint32_t sector = offset / w->sector_size;
+        uint32_t n = (sector + 1) * w->sector_size - offset;
+        if (n > size)
+        {
+            n = size;
+        }
+
+        if (w->mode == UPARAM_WRITER_MARK)
+        {
+            if (w->dirty)
+            {
+                sector_mark(w, sector);
+            }
+        }
+        else if (w->mode == UPARAM_WRITER_COMPARE)
+        {
+            //已经确定要重写的扇区不用再比较
+            if (!sector_marked(w, sector))
+            {
+                int ret = writer_compare(w, offset, p, n);
+                if (ret < 0)
+                {
+                    return RT_ERROR;
+                }
+                //只把1写成0时记下来在原位置编程, 头部和区间用完时还是重写扇区
+                if (ret == 2 && (offset < IMAGE_DATA_OFFSET || overwrite_add(w, w->diff_start, w->diff_end - w->diff_start) != RT_EOK))
+                {
+                    ret = 1;
+                }
+                if (ret == 1)
+                {
+                    sector_mark(w, sector);
+                }
+            }
+        }
+        else if (sector_marked(w, sector))
+        {
+            if (writer_append(w, offset, p, n) != RT_EOK)
+            {
+                return RT_ERROR;
+            }
+        }
+        else if (w->over_num > 0 && overwrite_put(w, offset, p, n) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+
+        offset += n;
+        p += n;
+        size -= n;
+    }
+    return RT_EOK;
+}
+
+#ifdef UPARAM_USING_COMPRESS
+/* 编码器的原样字节缓冲不放在栈上, 保存时有保存锁保护 */
+static param_rle_encoder_struct rle_enc;
+
+/**
+  * @brief  rle_put_literal
+  * @note   输出积累的原样字节
+  * @retval RT_EOK 成功
+  */
+static rt_err_t rle_put_literal(param_writer_struct *w, param_rle_encoder_struct *e)
+{
+    uint8_t ctrl = e->literal_len - 1;
+
+    if (e->literal_len == 0)
+    {
+        return RT_EOK;
+    }
+    if (writer_put(w, e->offset, &ctrl, 1) != RT_EOK || writer_put(w, e->offset + 1, e->literal, e->literal_len) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    e->offset += 1 + e->literal_len;
+    e->literal_len = 0;
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  rle_put_run
+  * @note   结束当前的重复段, 够长时输出为重复段, 否则并入原样字节
+  * @retval RT_EOK 成功
+  */
+static rt_err_t rle_put_run(param_writer_struct *w, param_rle_encoder_struct *e)
+{
+    if (e->run >= UPARAM_RLE_RUN_MIN)
+    {
+        uint8_t rec[2] = {0x80 | (e->run - UPARAM_RLE_RUN_MIN), e->value};
+
+        if (rle_put_literal(w, e) != RT_EOK || writer_put(w, e->offset, rec, 2) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+        e->offset += 2;
+    }
+    else
+    {
+        for (uint8_t i = 0; i < e->run; i++)
+        {
+            e->literal[e->literal_len++] = e->value;
+            if (e->literal_len == UPARAM_RLE_LITERAL_MAX && rle_put_literal(w, e) != RT_EOK)
+            {
+                return RT_ERROR;
+            }
+        }
+    }
+    e->run = 0;
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  rle_put
+  * @note   压缩数据并交给写入器. 输出只取决于之前的输入, 同样的前缀压缩结果相同,
+  *         修改点之前的扇区不用重写
+  * @param  *w: 写入器
+  * @param  *e: 编码器
+  * @retval RT_EOK 成功
+  */
+static rt_err_t rle_put(param_writer_struct *w, param_rle_encoder_struct *e, const uint8_t *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (e->run > 0 && data[i] == e->value && e->run < UPARAM_RLE_RUN_MAX)
+        {
+            e->run++;
+            continue;
+        }
+        if (e->run > 0 && rle_put_run(w, e) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+        e->value = data[i];
+        e->run = 1;
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  rle_finish
+  * @note   输出剩下的数据
+  * @retval RT_EOK 成功
+  */
+static rt_err_t rle_finish(param_writer_struct *w, param_rle_encoder_struct *e)
+{
+    if (rle_put_run(w, e) != RT_EOK || rle_put_literal(w, e) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    return RT_EOK;
+}
+#endif
+
+/**
+  * @brief  uparam_header_prepare
+  * @note   计算保存用的头部, 包括布局指纹和数据段的CRC-32
+  * @retval None
+  */
+static void uparam_header_prepare(void)
+{
+    uint32_t crc = 0;
+
+    //和 uparam_image_walk 生成的数据段一致
+    if (flush_snap != RT_NULL)
+    {
+        crc = uparam_crc32(0, flush_snap, store->header.size.u32);
+    }
+    else
+    {
+        for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+        {
+            crc = uparam_crc32(crc, par_addr[ADDR_G(n)], par_size[ADDR_G(n)]);
+        }
+    }
+
+    store->header.header = UPARAM_HEADER_MAGIC;
+    store->header.version = IMAGE_FORMAT;
+    store->header.layout = store->layout;
+    store->header.crc = uparam_crc32(0, &store->header, sizeof(param_header_struct) - 8);
+    store->header.image_crc = crc;
+}
+
+/**
+  * @brief  uparam_image_walk
+  * @note   按保存格式依次生成镜像的每段数据交给写入器, 头部只参与比较, 编程时最后单独写,
+  *         镜像CRC和CRC槽不在这里生成. 目录和数据段都按地址顺序排列
+  * @param  *w: 写入器
+  * @retval RT_EOK 成功
+  */
+static rt_err_t uparam_image_walk(param_writer_struct *w)
+{
+    uint32_t offset = IMAGE_DATA_OFFSET;
+    param_p pa;
+
+    //镜像CRC单独处理, 不参与比较
+    if (w->mode == UPARAM_WRITER_COMPARE &&
+        writer_put(w, 0, &store->header, sizeof(param_header_struct) - 4) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+
+    //目录, 只有布局变化时才会不同
+    w->dirty = 0;
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        pa.id = param_key(addr_index[n].list, addr_index[n].index);
+        pa.size = par_size[ADDR_G(n)];
+        if (writer_put(w, offset, &pa, sizeof(param_p)) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+        offset += sizeof(param_p);
+    }
+
+    //数据段, 有快照时从快照里取
+    const uint8_t *snap = flush_snap;
+#ifdef UPARAM_USING_COMPRESS
+    memset(&rle_enc, 0, sizeof(rle_enc));
+    rle_enc.offset = offset;
+#endif
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        uint16_t li = addr_index[n].list, i = addr_index[n].index;
+        uint16_t size = par_size[PAR_G(li, i)];
+        const uint8_t *data = (snap != RT_NULL) ? snap : par_addr[PAR_G(li, i)];
+
+#ifdef UPARAM_USING_COMPRESS
+        //压缩后修改点之后的数据都会移动, 后面的扇区都要重写
+        w->dirty |= (FLUSH_DIRTY(li)[i / 8] & (1 << (i % 8))) != 0;
+        if (rle_put(w, &rle_enc, data, size) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+#else
+        w->dirty = (FLUSH_DIRTY(li)[i / 8] & (1 << (i % 8))) != 0;
+        if (writer_put(w, offset, data, size) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+        offset += size;
+#endif
+        if (snap != RT_NULL)
+        {
+            snap += size;
+        }
+    }
+#ifdef UPARAM_USING_COMPRESS
+    if (rle_finish(w, &rle_enc) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    offset = rle_enc.offset;
+#endif
+    w->size = offset;
+
+    return RT_EOK;
+}
+
+#ifdef UPARAM_USING_LOCK
+/**
+  * @brief  flush_snapshot_take
+  * @note   在写者锁内按地址顺序复制数据段, 并把修改标记移到flushing, 之后写flash不再阻塞写者.
+  *         内存不够时不用快照, 一直持有写者锁到保存结束
+  * @retval None
+  */
+static void flush_snapshot_take(void)
+{
+    uint32_t offset = 0;
+
+    param_lock();
+    if (uparam_build_index() == RT_EOK && store->header.size.u32 > 0)
+    {
+        flush_snap = (uint8_t *)UPARAM_MALLOC(store->header.size.u32);
+    }
+    if (flush_snap != RT_NULL)
+    {
+        for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+        {
+            uint32_t g = ADDR_G(n);
+            memcpy(flush_snap + offset, par_addr[g], par_size[g]);
+            offset += par_size[g];
+        }
+    }
+    for (int li = 0; li < param_index; li++)
+    {
+        if (!IN_STORE(li))
+        {
+            continue;
+        }
+        uint16_t bit_num = UPARAM_BIT_BYTES(ls[li].par_list_size);
+        for (int b = 0; b < bit_num; b++)
+        {
+            ls[li].flushing[b] |= ls[li].dirty[b];
+            ls[li].dirty[b] = 0;
+        }
+    }
+    if (flush_snap != RT_NULL)
+    {
+        param_unlock();
+    }
+}
+
+/**
+  * @brief  flush_snapshot_release
+  * @note   释放快照, 保存失败时把修改标记并回dirty, 下次再保存
+  * @param  ok: 保存是否成功
+  * @retval None
+  */
+static void flush_snapshot_release(int ok)
+{
+    if (flush_snap != RT_NULL)
+    {
+        param_lock();
+        UPARAM_FREE(flush_snap);
+        flush_snap = RT_NULL;
+    }
+    for (int li = 0; li < param_index && !ok; li++)
+    {
+        if (!IN_STORE(li))
+        {
+            continue;
+        }
+        uint16_t bit_num = UPARAM_BIT_BYTES(ls[li].par_list_size);
+        for (int b = 0; b < bit_num; b++)
+        {
+            ls[li].dirty[b] |= ls[li].flushing[b];
+            ls[li].flushing[b] = 0;
+        }
+    }
+    param_unlock();
+}
+#endif
+
+/**
+  * @brief  image_writeall
+  * @note   将参数表里面修改过的参数写入到flash
+  *         先找出内容有变化的扇区, 只擦除并重写这些扇区, 记录按页拼接后整页编程.
+  *         分区允许再编程时, 只把1写成0的修改直接在原位置编程, 不擦除扇区
+  * @retval 
+  */
+static uint16_t image_writeall()
+{
+    uint8_t *temp = io_write_buf;
+    param_writer_struct writer;
+    uint32_t data_offset = IMAGE_DATA_OFFSET;
+    uint32_t sectors = 0;
+    uint8_t crc_changed;
+
+    if (write_protect < 1)
+    {
+        LOG_E("Uparam should read once before write!");
+        return 0;
+    }
+
+    if (uparam_build_index() != RT_EOK)
+    {
+        return 0;
+    }
+
+    //计算要写入的总字节数 header + 目录 + 数据
+    uint32_t allsize = data_offset + sizeof(param_p) * store->header.cnt.u32 + store->header.size.u32;
+
+    uparam_header_prepare();
+    memset(&writer, 0, sizeof(writer));
+    writer.part = par_part;
+    writer.buf = temp;
+    writer.sector_size = uparam_part_sector_size(par_part);
+    writer.overwrite = uparam_part_overwrite(par_part);
+#ifdef UPARAM_USING_COMPRESS
+    //先空跑一遍得到压缩后的长度
+    writer.mode = UPARAM_WRITER_SIZE;
+    uparam_image_walk(&writer);
+    allsize = writer.size;
+#endif
+    allsize = UPARAM_ALIGN(allsize, UPARAM_WRITE_GRAN);
+    //存储区后面可能是别的存储区, 不能写出界
+    if (allsize > store->len)
+    {
+        LOG_E("Uparam image is larger than the store, size: %d", allsize);
+        return 0;
+    }
+    writer.end = allsize;
+    LOG_D("Uparam write, cnt: %d, data size: %d, all size: %d!", store->header.cnt.u32, store->header.size.u32, allsize);
+
+    //找出需要重写的扇区, 旧格式的镜像全部重写
+#ifndef UPARAM_USING_DIRTY_API_ONLY
+    writer.mode = UPARAM_WRITER_COMPARE;
+    if (store->version != IMAGE_FORMAT)
+    {
+        memset(writer.sector_mask, 0xFF, sizeof(writer.sector_mask));
+    }
+    else if (uparam_image_walk(&writer) != RT_EOK)
+    {
+        LOG_E("Uparam compare failed!");
+        return 0;
+    }
+#else
+    if (store->match && store->version == IMAGE_FORMAT)
+    {
+        writer.mode = UPARAM_WRITER_MARK;
+        uparam_image_walk(&writer);
+    }
+    else
+    {
+        memset(writer.sector_mask, 0xFF, sizeof(writer.sector_mask));
+    }
+#endif
+
+    //镜像CRC变了但是头部所在扇区不用重写时写到空的CRC槽里, 没有空槽就重写头部
+    crc_changed = (store->header.image_crc != store->crc);
+    if (crc_changed && store->crc_slots >= UPARAM_CRC_SLOTS)
+    {
+        sector_mark(&writer, 0);
+    }
+
+    //擦除连续的标记扇区
+    uint32_t sector_num = (allsize + writer.sector_size - 1) / writer.sector_size;
+    for (uint32_t s = 0; s < sector_num;)
+    {
+        uint32_t run = 0;
+        while (s + run < sector_num && sector_marked(&writer, s + run))
+        {
+            run++;
+        }
+        if (run > 0)
+        {
+            //擦除失败时不能在没擦干净的扇区上编程, 也不能写新的CRC和头部
+            if (flash_erase(par_part, s * writer.sector_size, run * writer.sector_size) < 0)
+            {
+                LOG_E("Uparam erase failed! offset: %d, size: %d", s * writer.sector_size, run * writer.sector_size);
+                store->match = 0;
+                return 0;
+            }
+            sectors += run;
+        }
+        s += run + 1;
+    }
+
+#ifdef UPARAM_USING_DIRTY_API_ONLY
+    //没有要重写的扇区时flash不变, 没有标记的修改不保存, 镜像CRC也不变
+    crc_changed = crc_changed && (sectors > 0 || writer.over_num > 0);
+#endif
+    if (sectors == 0 && writer.over_num == 0 && !crc_changed)
+    {
+        LOG_D("Uparam nothing changed!");
+        last_prog_calls = 0;
+        uparam_clear_dirty();
+        store->match = 1;
+        return store->header.cnt.u32;
+    }
+
+    //编程标记的扇区和在原位置再编程的区间
+    writer.mode = UPARAM_WRITER_PROGRAM;
+    writer.offset = 0;
+    writer.len = 0;
+    if (uparam_image_walk(&writer) != RT_EOK || writer_program(&writer) != RT_EOK)
+    {
+        LOG_E("Uparam write data failed!");
+        return 0;
+    }
+#ifdef UPARAM_USING_DIRTY_API_ONLY
+    //没有标记的修改只在内存里, 没重写的扇区还是旧数据. 数据段所在的扇区没有全部重写时镜像CRC按flash里的数据段重新计算,
+    //否则漏标记一个参数整个镜像都会校验失败
+    uint32_t data_start = data_offset + sizeof(param_p) * store->header.cnt.u32, s;
+    for (s = data_start / writer.sector_size; s < sector_num && sector_marked(&writer, s); s++)
+    {
+    }
+    if (s < sector_num)
+    {
+        param_reader_struct reader;
+        uint32_t crc;
+
+        memset(&reader, 0, sizeof(reader));
+        reader.part = par_part;
+        reader.buf = (read_buf != RT_NULL) ? read_buf : io_read_buf;
+        reader.buf_size = (read_buf != RT_NULL) ? read_buf_size : sizeof(io_read_buf);
+        if (image_data_crc(&reader, data_start, store->header.size.u32, (IMAGE_FORMAT & UPARAM_FORMAT_RLE) != 0, &crc) != RT_EOK)
+        {
+            LOG_E("Uparam read image crc failed!");
+            return 0;
+        }
+        store->header.image_crc = crc;
+        crc_changed = (crc != store->crc);
+    }
+#endif
+
+    //最后写入header, 或者把镜像CRC写到下一个CRC槽
+    if (sector_marked(&writer, 0))
+    {
+        memset(temp, 0xFF, IMAGE_SLOT_OFFSET);
+        memcpy(temp, &store->header, sizeof(param_header_struct));
+        if (flash_write(par_part, 0, temp, IMAGE_SLOT_OFFSET) != IMAGE_SLOT_OFFSET)
+        {
+            LOG_E("Uparam write header failed!");
+            return 0;
+        }
+        writer.prog_calls++;
+        store->crc_slots = 0;
+    }
+    else if (crc_changed)
+    {
+        memset(temp, 0xFF, IMAGE_SLOT_SIZE);
+        memcpy(temp, &store->header.image_crc, 4);
+        if (flash_write(par_part, IMAGE_SLOT_OFFSET + store->crc_slots * IMAGE_SLOT_SIZE, temp, IMAGE_SLOT_SIZE) != IMAGE_SLOT_SIZE)
+        {
+            LOG_E("Uparam write image crc failed!");
+            return 0;
+        }
+        writer.prog_calls++;
+        store->crc_slots++;
+    }
+    store->crc = store->header.image_crc;
+    last_prog_calls = writer.prog_calls;
+    uparam_clear_dirty();
+    store->match = 1;
+    store->version = IMAGE_FORMAT;
+    LOG_D("Uparam write param, cnt: %d, sectors: %d, overwrite: %d, program: %d!", store->header.cnt.u32, sectors,
+          writer.over_num, last_prog_calls);
+    return store->header.cnt.u32;
+}
+
+#endif
+
+/**
+  * @brief  counter_valid
+  * @note   计数器只能是4或8字节的'u'类型参数
+  * @retval 1 可以作为计数器
+  */
+static int counter_valid(uint32_t g)
+{
+    return par_type[g] == 'u' && (par_size[g] == 4 || par_size[g] == 8);
+}
+
+static uint64_t counter_get(uint32_t g)
+{
+    if (par_size[g] == 4)
+    {
+        uint32_t v;
+        memcpy(&v, par_addr[g], 4);
+        return v;
+    }
+    uint64_t v;
+    memcpy(&v, par_addr[g], 8);
+    return v;
+}
+
+static void counter_set(uint32_t g, uint64_t value)
+{
+    if (par_size[g] == 4)
+    {
+        uint32_t v = (uint32_t)value;
+        memcpy(par_addr[g], &v, 4);
+        return;
+    }
+    memcpy(par_addr[g], &value, 8);
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  counter_fill
+  * @note   生成计数器的当前值记录, 补0xFF对齐到最小写入单位
+  * @param  *buf: 输出, COUNTER_REC_SIZE 字节
+  * @retval None
+  */
+static void counter_fill(uint8_t *buf, uint16_t li, uint16_t i)
+{
+    param_counter_rec_struct rec;
+    uint32_t g = PAR_G(li, i);
+
+    rec.id = param_key(li, i);
+    rec.size = (uint8_t)par_size[g];
+    rec.value = counter_get(g);
+    rec.crc = cal_crc(0x55, (uint8_t *)&rec, sizeof(rec) - 1);
+    memset(buf, 0xFF, COUNTER_REC_SIZE);
+    memcpy(buf, &rec, sizeof(rec));
+}
+
+/**
+  * @brief  counter_saved
+  * @note   计数器的当前值已经在flash里, 清除修改标记
+  * @retval None
+  */
+static void counter_saved(uint16_t li, uint16_t i)
+{
+    ls[li].read_valid[i / 8] |= 1 << (i % 8);
+    ls[li].dirty[i / 8] &= ~(1 << (i % 8));
+}
+
+/**
+  * @brief  counter_advance
+  * @note   擦除下一个扇区(最旧的扇区), 先写入所有计数器的快照, 最后写扇区头部.
+  *         中途掉电时新扇区没有头部, 加载时还是用原来的扇区
+  * @retval RT_EOK 成功
+  */
+static rt_err_t counter_advance(void)
+{
+    uint32_t sector_size = uparam_part_sector_size(par_part);
+    uint32_t next = (store->ring_pos == 0) ? 0 : (store->ring_sector + 1) % (store->len / sector_size);
+    uint32_t base = next * sector_size;
+    uint32_t pos = COUNTER_DATA_START, len = 0;
+    param_counter_sector_struct head;
+
+    if (flash_erase(par_part, base, sector_size) < 0)
+    {
+        LOG_E("Uparam counter erase failed! offset: %d", base);
+        return RT_ERROR;
+    }
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        counter_fill(io_write_buf + len, addr_index[n].list, addr_index[n].index);
+        len += COUNTER_REC_SIZE;
+        if (len + COUNTER_REC_SIZE > sizeof(io_write_buf) || store_next(n + 1) >= addr_index_num)
+        {
+            if (flash_write(par_part, base + pos, io_write_buf, len) != len)
+            {
+                LOG_E("Uparam counter write failed! offset: %d, size: %d", base + pos, len);
+                return RT_ERROR;
+            }
+            pos += len;
+            len = 0;
+        }
+    }
+
+    head.magic = UPARAM_COUNTER_MAGIC;
+    head.seq = (store->ring_pos == 0) ? 1 : store->ring_seq + 1;
+    head.crc = cal_crc(0x55, (uint8_t *)&head, sizeof(head) - 1);
+    memset(io_write_buf, 0xFF, COUNTER_DATA_START);
+    memcpy(io_write_buf, &head, sizeof(head));
+    if (flash_write(par_part, base, io_write_buf, COUNTER_DATA_START) != COUNTER_DATA_START)
+    {
+        LOG_E("Uparam counter write failed! offset: %d, size: %d", base, COUNTER_DATA_START);
+        return RT_ERROR;
+    }
+    store->ring_sector = next;
+    store->ring_seq = head.seq;
+    store->ring_pos = pos;
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        counter_saved(addr_index[n].list, addr_index[n].index);
+    }
+    LOG_D("Uparam counter (%s) sector: %d, seq: %d", store->part_name, next, head.seq);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  counter_put
+  * @note   在当前扇区追加一条计数器记录, 扇区满了时换到下一个扇区
+  * @retval RT_EOK 成功
+  */
+static rt_err_t counter_put(uint16_t li, uint16_t i)
+{
+    uint32_t sector_size = uparam_part_sector_size(par_part);
+    uint32_t offset = store->ring_sector * sector_size + store->ring_pos;
+
+    if (store->ring_pos == 0 || store->ring_pos + COUNTER_REC_SIZE > sector_size)
+    {
+        return counter_advance();
+    }
+    counter_fill(io_write_buf, li, i);
+    //写失败的位置可能已经写了一部分, 不再使用
+    store->ring_pos += COUNTER_REC_SIZE;
+    if (flash_write(par_part, offset, io_write_buf, COUNTER_REC_SIZE) != COUNTER_REC_SIZE)
+    {
+        LOG_E("Uparam counter write failed! offset: %d, size: %d", offset, COUNTER_REC_SIZE);
+        return RT_ERROR;
+    }
+    counter_saved(li, i);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  counter_readall
+  * @note   找到序号最大的扇区, 从开头的快照开始按顺序回放记录, 后面的记录覆盖前面的值
+  * @retval 读取成功的计数器个数
+  */
+static uint16_t counter_readall(void)
+{
+    uint32_t sector_size = uparam_part_sector_size(par_part);
+    param_counter_sector_struct head;
+    param_counter_rec_struct rec;
+    param_reader_struct reader;
+    uint16_t read_num = 0, li, i;
+    uint8_t *data;
+
+    write_protect = 1;
+    store->ring_pos = 0;
+    store->ring_seq = 0;
+    for (uint32_t k = 0; k < store->len / sector_size; k++)
+    {
+        if (flash_read(par_part, k * sector_size, (uint8_t *)&head, sizeof(head)) != sizeof(head))
+        {
+            LOG_E("Uparam read failed! offset: %d, size: %d", k * sector_size, (int)sizeof(head));
+            return 0;
+        }
+        if (head.magic == UPARAM_COUNTER_MAGIC && head.crc == cal_crc(0x55, (uint8_t *)&head, sizeof(head) - 1) &&
+            (store->ring_pos == 0 || head.seq > store->ring_seq))
+        {
+            store->ring_sector = k;
+            store->ring_seq = head.seq;
+            store->ring_pos = COUNTER_DATA_START;
+        }
+    }
+    if (store->ring_pos == 0)
+    {
+        LOG_W("Uparam counter (%s) is empty!", store->part_name);
+        return 0;
+    }
+
+    //重新统计读出的计数器
+    for (li = 0; li < param_index; li++)
+    {
+        if (IN_STORE(li))
+        {
+            memset(ls[li].read_valid, 0, UPARAM_BIT_BYTES(ls[li].par_list_size));
+        }
+    }
+
+    memset(&reader, 0, sizeof(reader));
+    reader.part = par_part;
+    reader.buf = (read_buf != RT_NULL) ? read_buf : io_read_buf;
+    reader.buf_size = (read_buf != RT_NULL) ? read_buf_size : sizeof(io_read_buf);
+    reader.offset = store->ring_sector * sector_size + COUNTER_DATA_START;
+    reader.end = (store->ring_sector + 1) * sector_size;
+    while ((data = reader_peek(&reader, COUNTER_REC_SIZE)) != RT_NULL)
+    {
+        uint32_t k;
+
+        for (k = 0; k < sizeof(rec) && data[k] == 0xFF; k++)
+        {
+        }
+        if (k == sizeof(rec))
+        {
+            break;
+        }
+        memcpy(&rec, data, sizeof(rec));
+        reader.pos += COUNTER_REC_SIZE;
+        store->ring_pos += COUNTER_REC_SIZE;
+        if (rec.crc != cal_crc(0x55, data, sizeof(rec) - 1))
+        {
+            LOG_W("Uparam counter record broken, offset: 0x%X", store->ring_sector * sector_size + store->ring_pos - COUNTER_REC_SIZE);
+            stats_add(crc_errors, 1);
+            continue;
+        }
+        if (!find_param_by_key(rec.id, rec.size, 0, &li, &i) || !IN_STORE(li))
+        {
+            LOG_W("param is not exist, id: 0x%X ,read size: %d", rec.id, rec.size);
+            continue;
+        }
+        if (counter_get(PAR_G(li, i)) != rec.value)
+        {
+            seq_begin();
+            counter_set(PAR_G(li, i), rec.value);
+            seq_end();
+            notify_mark(li, i);
+        }
+        if ((ls[li].read_valid[i / 8] & (1 << (i % 8))) == 0)
+        {
+            ls[li].read_valid[i / 8] |= 1 << (i % 8);
+            read_num++;
+        }
+    }
+    LOG_D("read counter success count: %d, sector: %d, seq: %d", read_num, store->ring_sector, store->ring_seq);
+
+    return read_num;
+}
+
+/**
+  * @brief  counter_writeall
+  * @note   修改过的计数器和flash里还没有的计数器各追加一条记录, 还没有可用扇区时写入快照
+  * @retval 存储区的计数器个数, 失败返回0
+  */
+static uint16_t counter_writeall(void)
+{
+    if (write_protect < 1)
+    {
+        LOG_E("Uparam should read once before write!");
+        return 0;
+    }
+    if (store->ring_pos == 0 && counter_advance() != RT_EOK)
+    {
+        return 0;
+    }
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        uint16_t li = addr_index[n].list, i = addr_index[n].index;
+
+        if (((ls[li].dirty[i / 8] & (1 << (i % 8))) || !(ls[li].read_valid[i / 8] & (1 << (i % 8)))) &&
+            counter_put(li, i) != RT_EOK)
+        {
+            return 0;
+        }
+    }
+    return store->header.cnt.u32;
+}
+
+/**
+  * @brief  counter_check
+  * @note   计数器存储区至少两个扇区, 参数都是计数器, 快照最多占半个扇区
+  * @retval RT_EOK 成功
+  */
+static rt_err_t counter_check(void)
+{
+    uint32_t sector_size = uparam_part_sector_size(par_part);
+
+    if (store->len / sector_size < 2)
+    {
+        LOG_E("Uparam counter (%s) needs at least 2 sectors!", store->part_name);
+        return RT_ERROR;
+    }
+    for (uint32_t n = store_next(0); n < addr_index_num; n = store_next(n + 1))
+    {
+        if (!counter_valid(ADDR_G(n)))
+        {
+            LOG_E("param %s can't be a counter, must be 'u' with 4 or 8 bytes",
+                  ls[addr_index[n].list].par_list_add[addr_index[n].index].name);
+            return RT_ERROR;
+        }
+    }
+    if (COUNTER_DATA_START + store->header.cnt.u32 * COUNTER_REC_SIZE > sector_size / 2)
+    {
+        LOG_E("Uparam counter (%s) has too many counters: %d", store->part_name, store->header.cnt.u32);
+        return RT_ERROR;
+    }
+    return RT_EOK;
+}
+#endif
+
+/**
+  * @brief  uparam_flush_prog_count
+  * @note   上一次写入flash时的编程次数(包括头部)
+  * @retval 
+  */
+uint32_t uparam_flush_prog_count(void)
+{
+    return last_prog_calls;
+}
+
+#ifdef UPARAM_USING_LOG
+/* 参数还没有保存到日志里 */
+#define LOG_LOC_NONE 0xFFFFFFFF
+/* "UPL3", 记录头部为参数ID+2字节长度; 旧的"UPL2"扇区记录头部是参数地址+2字节长度,
+ * "UPLG"扇区是参数地址+1字节长度, 只读取, 加载后整体重写 */
+#define UPARAM_LOG_MAGIC 0x334C5055
+#define UPARAM_LOG_MAGIC_V2 0x324C5055
+#define UPARAM_LOG_MAGIC_V1 0x474C5055
+
+#define LOG_FORMAT_SIZE UPARAM_ALIGN(sizeof(param_log_format_struct), UPARAM_WRITE_GRAN)
+#define LOG_SEQ_SIZE UPARAM_ALIGN(sizeof(param_log_seq_struct), UPARAM_WRITE_GRAN)
+#define LOG_DATA_START (LOG_FORMAT_SIZE + LOG_SEQ_SIZE)
+#define LOG_RECORD_SIZE(size) UPARAM_ALIGN(sizeof(param_p) + (size) + 1, UPARAM_WRITE_GRAN)
+#define LOG_RECORD_SIZE_V1(size) UPARAM_ALIGN(sizeof(param_p_v2) + (size) + 1, UPARAM_WRITE_GRAN)
+
+/* 扇区状态: 未格式化, 已格式化未使用, 使用中 */
+#define LOG_SECTOR_BAD 0
+#define LOG_SECTOR_SPARE 1
+#define LOG_SECTOR_USED 2
+
+static param_log_struct par_log;
+
+/**
+  * @brief  log_sector_state
+  * @note   读扇区头部, 得到扇区状态
+  * @param  sector: 扇区
+  * @param  *seq: 使用中的扇区返回序号
+  * @param  *legacy: 返回旧格式扇区的版本(1或2), 当前格式为0, 不需要时为RT_NULL
+  * @retval LOG_SECTOR_BAD/LOG_SECTOR_SPARE/LOG_SECTOR_USED
+  */
+static int log_sector_state(uint32_t sector, uint32_t *seq, uint8_t *legacy)
+{
+    uint8_t temp[LOG_DATA_START];
+    param_log_format_struct fmt;
+    param_log_seq_struct sq;
+
+    if (flash_read(par_part, sector * par_log.sector_size, temp, LOG_DATA_START) != LOG_DATA_START)
+    {
+        return LOG_SECTOR_BAD;
+    }
+    memcpy(&fmt, temp, sizeof(fmt));
+    memcpy(&sq, temp + LOG_FORMAT_SIZE, sizeof(sq));
+
+    if ((fmt.magic != UPARAM_LOG_MAGIC && fmt.magic != UPARAM_LOG_MAGIC_V2 && fmt.magic != UPARAM_LOG_MAGIC_V1) ||
+        fmt.crc != cal_crc(0x55, (uint8_t *)&fmt, sizeof(fmt) - 1))
+    {
+        return LOG_SECTOR_BAD;
+    }
+    par_log.erase_cnt[sector] = fmt.erase_cnt;
+    if (legacy != RT_NULL)
+    {
+        *legacy = (fmt.magic == UPARAM_LOG_MAGIC_V1) ? 1 : (fmt.magic == UPARAM_LOG_MAGIC_V2) ? 2 : 0;
+    }
+
+    if (sq.seq == 0xFFFFFFFF && sq.crc == 0xFF)
+    {
+        //旧格式的空闲扇区要重新格式化后才能写入
+        return (fmt.magic == UPARAM_LOG_MAGIC) ? LOG_SECTOR_SPARE : LOG_SECTOR_BAD;
+    }
+    //序号没写完整的扇区里不会有记录, 当作未格式化
+    if (sq.crc != cal_crc(0x55, (uint8_t *)&sq.seq, 4))
+    {
+        return LOG_SECTOR_BAD;
+    }
+    *seq = sq.seq;
+    return LOG_SECTOR_USED;
+}
+
+/**
+  * @brief  log_format
+  * @note   擦除扇区并写入格式化信息, 擦除次数加1
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_format(param_writer_struct *w, uint32_t sector)
+{
+    uint8_t temp[LOG_FORMAT_SIZE];
+    param_log_format_struct fmt;
+
+    if (flash_erase(par_part, sector * par_log.sector_size, par_log.sector_size) < 0)
+    {
+        return RT_ERROR;
+    }
+    fmt.magic = UPARAM_LOG_MAGIC;
+    fmt.erase_cnt = ++par_log.erase_cnt[sector];
+    fmt.crc = cal_crc(0x55, (uint8_t *)&fmt, sizeof(fmt) - 1);
+    memset(temp, 0xFF, sizeof(temp));
+    memcpy(temp, &fmt, sizeof(fmt));
+    if (flash_write(par_part, sector * par_log.sector_size, temp, sizeof(temp)) != sizeof(temp))
+    {
+        return RT_ERROR;
+    }
+    w->prog_calls++;
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  log_activate
+  * @note   开始使用一个已格式化的扇区, 写入新的序号
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_activate(param_writer_struct *w, uint32_t sector)
+{
+    uint8_t temp[LOG_SEQ_SIZE];
+    param_log_seq_struct sq;
+
+    sq.seq = ++par_log.seq;
+    sq.crc = cal_crc(0x55, (uint8_t *)&sq.seq, 4);
+    memset(temp, 0xFF, sizeof(temp));
+    memcpy(temp, &sq, sizeof(sq));
+    if (flash_write(par_part, sector * par_log.sector_size + LOG_FORMAT_SIZE, temp, sizeof(temp)) != sizeof(temp))
+    {
+        return RT_ERROR;
+    }
+    w->prog_calls++;
+    par_log.head = sector;
+    par_log.head_off = LOG_DATA_START;
+
+    return RT_EOK;
+}
+
+static rt_err_t log_append(param_writer_struct *w, uint16_t li, uint16_t i);
+
+/**
+  * @brief  log_advance
+  * @note   当前扇区写满, 切换到下一个空闲扇区, 再回收它后面最旧的扇区作为新的空闲扇区,
+  *         回收时把里面仍然有效的记录搬到当前扇区
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_advance(param_writer_struct *w)
+{
+    uint32_t next, victim, seq;
+    int state;
+
+    if (writer_program(w) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    if (++par_log.advances > par_log.sector_num)
+    {
+        LOG_E("Uparam log is full!");
+        return RT_ERROR;
+    }
+
+    next = (par_log.head >= par_log.sector_num) ? 0 : (par_log.head + 1) % par_log.sector_num;
+    if (log_sector_state(next, &seq, RT_NULL) != LOG_SECTOR_SPARE && log_format(w, next) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    if (log_activate(w, next) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+
+    //保证总有一个空闲扇区
+    victim = (next + 1) % par_log.sector_num;
+    state = log_sector_state(victim, &seq, RT_NULL);
+    if (state == LOG_SECTOR_USED)
+    {
+        uint32_t start = victim * par_log.sector_size;
+        for (int li = 0; li < param_index; li++)
+        {
+            for (int i = 0; i < ls[li].par_list_size; i++)
+            {
+                uint32_t loc = ls[li].log_loc[i];
+                if (loc != LOG_LOC_NONE && loc >= start && loc < start + par_log.sector_size &&
+                    log_append(w, li, i) != RT_EOK)
+                {
+                    return RT_ERROR;
+                }
+            }
+        }
+        if (writer_program(w) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+    }
+    if (state != LOG_SECTOR_SPARE && log_format(w, victim) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    return RT_EOK;
+}
+
+/**
+  * @brief  log_append
+  * @note   追加一条参数记录, 当前扇区放不下时切换扇区, 记录的位置保存到log_loc
+  * @param  li: 所在参数表
+  * @param  i: 在参数表里的序号
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_append(param_writer_struct *w, uint16_t li, uint16_t i)
+{
+    uint8_t *address = par_addr[PAR_G(li, i)];
+    uint16_t size = par_size[PAR_G(li, i)];
+    uint32_t rsize = LOG_RECORD_SIZE(size);
+    uint8_t pad[UPARAM_WRITE_GRAN];
+    param_p rec;
+    uint8_t check;
+    uint32_t offset;
+
+    if (par_log.head >= par_log.sector_num || par_log.head_off + rsize > par_log.sector_size)
+    {
+        if (log_advance(w) != RT_EOK)
+        {
+            return RT_ERROR;
+        }
+    }
+    rec.id = param_key(li, i);
+    rec.size = size;
+    check = cal_crc(0x55, address, size);
+    memset(pad, 0xFF, sizeof(pad));
+    offset = par_log.head * par_log.sector_size + par_log.head_off;
+
+    //记录信息 + 数据 + 一字节校验, 补齐到最小写入单位
+    if (writer_append(w, offset, (uint8_t *)&rec, sizeof(param_p)) != RT_EOK ||
+        writer_append(w, offset + sizeof(param_p), address, size) != RT_EOK ||
+        writer_append(w, offset + sizeof(param_p) + size, &check, 1) != RT_EOK ||
+        writer_append(w, offset + sizeof(param_p) + size + 1, pad, rsize - sizeof(param_p) - size - 1) != RT_EOK)
+    {
+        return RT_ERROR;
+    }
+    ls[li].log_loc[i] = offset;
+    par_log.head_off += rsize;
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  log_load_sector
+  * @note   按顺序解析一个扇区里的记录. 校验时后面的记录覆盖前面记录的位置, 所有扇区都校验完后
+  *         再解析一遍, 只把每个参数最新的一条记录写入参数内存, 回放期间读者不会读到旧记录里的值.
+  *         比读缓冲大的记录校验时分块算校验, 写入时再分块读出
+  * @param  sector: 扇区
+  * @param  legacy: 旧格式扇区的版本, 1: 地址+1字节长度, 2: 地址+2字节长度
+  * @param  apply_end: 0 只校验并记录每个参数最新记录的位置; 否则写入最新的记录, 解析到这个位置的记录为止
+  * @retval 最后一条有效记录之后的位置, 记录损坏时返回扇区大小, 不再往这个扇区追加
+  */
+static uint32_t log_load_sector(uint32_t sector, uint8_t legacy, uint32_t apply_end)
+{
+    param_reader_struct reader;
+    uint32_t start = sector * par_log.sector_size;
+    uint32_t head = (legacy == 1) ? sizeof(param_p_v2) : sizeof(param_p);
+    param_p rec;
+    uint8_t *data;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.part = par_part;
+    reader.buf = (read_buf != RT_NULL) ? read_buf : io_read_buf;
+    reader.buf_size = (read_buf != RT_NULL) ? read_buf_size : sizeof(io_read_buf);
+    reader.offset = start + LOG_DATA_START;
+    reader.end = start + par_log.sector_size;
+
+    while (1)
+    {
+        uint32_t offset = reader.offset - (reader.len - reader.pos);
+        if (offset + head > reader.end || (apply_end != 0 && offset > apply_end) ||
+            (data = reader_peek(&reader, head)) == RT_NULL)
+        {
+            return offset - start;
+        }
+        if (legacy == 1)
+        {
+            param_p_v2 rec_v1;
+            memcpy(&rec_v1, data, sizeof(param_p_v2));
+            rec.id = rec_v1.address;
+            rec.size = (rec_v1.size == 0xFF) ? 0xFFFF : rec_v1.size;
+        }
+        else
+        {
+            memcpy(&rec, data, sizeof(param_p));
+        }
+        //擦除状态, 后面没有记录了
+        if (rec.id == 0xFFFFFFFF && rec.size == 0xFFFF)
+        {
+            return offset - start;
+        }
+
+        uint32_t rsize = (legacy == 1) ? LOG_RECORD_SIZE_V1(rec.size) : LOG_RECORD_SIZE(rec.size);
+        uint16_t li, i;
+        int found = find_param_by_key(rec.id, rec.size, legacy != 0, &li, &i);
+        if (offset + rsize > reader.end)
+        {
+            LOG_W("Uparam log record broken, offset: 0x%X", offset);
+            stats_add(crc_errors, 1);
+            return par_log.sector_size;
+        }
+        if (apply_end != 0)
+        {
+            //已经校验过, 只写入最新的记录, 内容有变化时才通知
+            uint8_t latest = found && ls[li].log_loc[i] == offset;
+
+            if (rsize <= reader.buf_size)
+            {
+                if ((data = reader_peek(&reader, rsize)) == RT_NULL)
+                {
+                    return par_log.sector_size;
+                }
+                reader.pos += rsize;
+                if (latest && param_write(par_addr[PAR_G(li, i)], data + head, rec.size))
+                {
+                    notify_mark(li, i);
+                }
+                continue;
+            }
+            if (latest)
+            {
+                reader.pos += head;
+                if (param_restore(&reader, RT_NULL, par_addr[PAR_G(li, i)], rec.size) != RT_EOK)
+                {
+                    return par_log.sector_size;
+                }
+                if (reader.changed)
+                {
+                    notify_mark(li, i);
+                }
+            }
+            reader_seek(&reader, offset + rsize);
+            continue;
+        }
+        if (rsize > reader.buf_size)
+        {
+            uint8_t check = 0x55;
+
+            //第一遍只校验, 记录损坏时不能改动参数
+            reader.pos += head;
+            if (reader_stream(&reader, RT_NULL, rec.size, RT_NULL, &check) != RT_EOK ||
+                (data = reader_peek(&reader, 1)) == RT_NULL || check != data[0])
+            {
+                LOG_W("Uparam log record broken, offset: 0x%X", offset);
+                stats_add(crc_errors, 1);
+                return par_log.sector_size;
+            }
+            reader_seek(&reader, offset + rsize);
+        }
+        else
+        {
+            if ((data = reader_peek(&reader, rsize)) == RT_NULL ||
+                cal_crc(0x55, data + head, rec.size) != data[head + rec.size])
+            {
+                LOG_W("Uparam log record broken, offset: 0x%X", offset);
+                stats_add(crc_errors, 1);
+                return par_log.sector_size;
+            }
+            reader.pos += rsize;
+        }
+
+        if (found)
+        {
+            ls[li].read_valid[i / 8] |= 1 << (i % 8);
+            ls[li].log_loc[i] = offset;
+        }
+    }
+}
+
+/**
+  * @brief  log_readall
+  * @note   按序号从旧到新回放所有使用中的扇区
+  * @retval 读取成功的参数个数
+  */
+static uint16_t log_readall()
+{
+    uint32_t seq, last_seq = 0, loaded = 0;
+    uint32_t newest = par_log.sector_num, newest_seq = 0;
+    uint8_t legacy = 0;
+    uint16_t read_num = 0;
+
+    write_protect = 1;
+    if (uparam_build_index() != RT_EOK)
+    {
+        return 0;
+    }
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            ls[li].log_loc[i] = LOG_LOC_NONE;
+        }
+    }
+    par_log.head = par_log.sector_num;
+    par_log.seq = 0;
+    par_log.legacy = 0;
+
+    //每个扇区的头部只读一次, 不在使用中的序号记为0
+    for (uint32_t s = 0; s < par_log.sector_num; s++)
+    {
+        par_log.sector_seq[s] = (log_sector_state(s, &seq, &legacy) == LOG_SECTOR_USED) ? seq : 0;
+        par_log.legacy |= legacy && par_log.sector_seq[s];
+        if (par_log.sector_seq[s] > newest_seq)
+        {
+            newest = s;
+            newest_seq = par_log.sector_seq[s];
+        }
+    }
+
+    //切换扇区时先激活下一个扇区, 再把它后面最旧扇区里的有效记录搬过来, 最后格式化最旧的扇区.
+    //最新扇区后面的扇区还在使用中说明回收被掉电打断, 最新扇区里只有搬了一部分的副本,
+    //不加载它, 记录仍然从原来的扇区读取. 下次切换扇区时它不是空闲扇区, 会重新格式化后再回收
+    if (!par_log.legacy && newest < par_log.sector_num && par_log.sector_seq[(newest + 1) % par_log.sector_num] != 0)
+    {
+        LOG_W("Uparam log sector %d was not reclaimed, drop the copies in sector %d", (newest + 1) % par_log.sector_num, newest);
+        par_log.sector_seq[newest] = 0;
+    }
+
+    //每次找序号比上一个大的最小的扇区, 扇区数不多, 不用排序
+    while (1)
+    {
+        uint32_t pick = par_log.sector_num, pick_seq = 0;
+
+        for (uint32_t s = 0; s < par_log.sector_num; s++)
+        {
+            seq = par_log.sector_seq[s];
+            if (seq != 0 && (loaded == 0 || seq > last_seq) && (pick == par_log.sector_num || seq < pick_seq))
+            {
+                pick = s;
+                pick_seq = seq;
+            }
+        }
+        if (pick == par_log.sector_num)
+        {
+            break;
+        }
+        //有旧格式扇区时才需要再区分每个扇区的格式
+        legacy = 0;
+        if (par_log.legacy)
+        {
+            log_sector_state(pick, &seq, &legacy);
+        }
+        par_log.head_off = log_load_sector(pick, legacy, 0);
+        //旧格式的扇区不再追加新记录
+        if (legacy)
+        {
+            par_log.head_off = par_log.sector_size;
+        }
+        par_log.head = pick;
+        par_log.seq = pick_seq;
+        last_seq = pick_seq;
+        loaded++;
+    }
+    //新激活的扇区序号要比所有扇区都大
+    par_log.seq = (newest_seq > par_log.seq) ? newest_seq : par_log.seq;
+
+    //只剩每个参数最新的记录, 和扇区顺序无关. 扇区序号已经用完, 换成每个扇区里最后一条最新记录的位置,
+    //没有最新记录的扇区不再读, 有的只读到最后一条
+    memset(par_log.sector_seq, 0, par_log.sector_num * sizeof(uint32_t));
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            uint32_t loc = ls[li].log_loc[i];
+            if (loc != LOG_LOC_NONE && loc > par_log.sector_seq[loc / par_log.sector_size])
+            {
+                par_log.sector_seq[loc / par_log.sector_size] = loc;
+            }
+        }
+    }
+    for (uint32_t s = 0; s < par_log.sector_num; s++)
+    {
+        if (par_log.sector_seq[s] == 0)
+        {
+            continue;
+        }
+        legacy = 0;
+        if (par_log.legacy)
+        {
+            log_sector_state(s, &seq, &legacy);
+        }
+        log_load_sector(s, legacy, par_log.sector_seq[s]);
+    }
+
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            read_num += (ls[li].log_loc[i] != LOG_LOC_NONE);
+        }
+    }
+    LOG_D("read param success count: %d, sectors: %d", read_num, loaded);
+    return read_num;
+}
+
+/**
+  * @brief  log_writeall
+  * @note   把修改过的参数追加到日志里, 不擦除
+  * @retval 
+  */
+static uint16_t log_writeall()
+{
+    param_writer_struct writer;
+    uint32_t cnt = 0;
+
+    if (write_protect < 1)
+    {
+        LOG_E("Uparam should read once before write!");
+        return 0;
+    }
+    //记录里的ID和参数地址、长度都来自索引
+    if (uparam_build_index() != RT_EOK)
+    {
+        return 0;
+    }
+
+    memset(&writer, 0, sizeof(writer));
+    writer.part = par_part;
+    writer.buf = io_write_buf;
+    writer.end = uparam_part_len(par_part);
+    writer.sector_size = par_log.sector_size;
+
+    //先找出所有要保存的参数, 再追加, 避免追加过程中比较到还没编程的数据
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            uint32_t loc = ls[li].log_loc[i];
+            //从旧格式扇区加载的参数全部按新格式重写
+            int changed = (loc == LOG_LOC_NONE) || par_log.legacy;
+
+#ifndef UPARAM_USING_DIRTY_API_ONLY
+            if (!changed)
+            {
+                changed = writer_compare(&writer, loc + sizeof(param_p), par_addr[PAR_G(li, i)], par_size[PAR_G(li, i)]);
+                if (changed < 0)
+                {
+                    LOG_E("Uparam compare failed!");
+                    return 0;
+                }
+            }
+#endif
+            if (changed)
+            {
+                ls[li].dirty[i / 8] |= 1 << (i % 8);
+            }
+        }
+    }
+
+    writer.offset = 0;
+    writer.len = 0;
+    par_log.advances = 0;
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            if ((ls[li].dirty[i / 8] & (1 << (i % 8))) == 0)
+            {
+                continue;
+            }
+            if (log_append(&writer, li, i) != RT_EOK)
+            {
+                LOG_E("Uparam log append failed!");
+                return 0;
+            }
+            cnt++;
+        }
+    }
+    if (writer_program(&writer) != RT_EOK)
+    {
+        LOG_E("Uparam write data failed!");
+        return 0;
+    }
+    //记录都已经重写, 剩下的旧格式扇区直接格式化, 下次启动不用再迁移
+    if (par_log.legacy)
+    {
+        for (uint32_t s = 0; s < par_log.sector_num; s++)
+        {
+            uint32_t seq;
+            uint8_t legacy = 0;
+            if (s != par_log.head && log_sector_state(s, &seq, &legacy) != LOG_SECTOR_SPARE && legacy &&
+                log_format(&writer, s) != RT_EOK)
+            {
+                LOG_E("Uparam format legacy sector failed!");
+                return 0;
+            }
+        }
+        par_log.legacy = 0;
+    }
+    last_prog_calls = writer.prog_calls;
+    uparam_clear_dirty();
+    LOG_D("Uparam log write param: %d, program: %d, head: %d/0x%X", cnt, last_prog_calls, par_log.head, par_log.head_off);
+    return param_header.cnt.u32;
+}
+
+/**
+  * @brief  log_write_param
+  * @note   只追加一个参数的记录, 不和flash比较其他参数, 扇区写满时和保存所有参数一样切换扇区
+  * @param  li: 所在参数表
+  * @param  i: 在参数表里的序号
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_write_param(uint16_t li, uint16_t i)
+{
+    param_writer_struct writer;
+
+    if (write_protect < 1)
+    {
+        LOG_E("Uparam should read once before write!");
+        return RT_ERROR;
+    }
+    memset(&writer, 0, sizeof(writer));
+    writer.part = par_part;
+    writer.buf = io_write_buf;
+    writer.end = uparam_part_len(par_part);
+    writer.sector_size = par_log.sector_size;
+    par_log.advances = 0;
+    if (log_append(&writer, li, i) != RT_EOK || writer_program(&writer) != RT_EOK)
+    {
+        LOG_E("Uparam log append failed!");
+        return RT_ERROR;
+    }
+    last_prog_calls = writer.prog_calls;
+    ls[li].dirty[i / 8] &= ~(1 << (i % 8));
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  log_erase_all
+  * @note   格式化所有扇区
+  * @retval None
+  */
+static void log_erase_all(void)
+{
+    param_writer_struct writer;
+
+    memset(&writer, 0, sizeof(writer));
+    for (uint32_t s = 0; s < par_log.sector_num; s++)
+    {
+        log_format(&writer, s);
+    }
+    par_log.head = par_log.sector_num;
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            ls[li].log_loc[i] = LOG_LOC_NONE;
+        }
+    }
+}
+
+/**
+  * @brief  log_init
+  * @note   日志模式初始化, 至少需要3个扇区, 除当前扇区和空闲扇区外要能放下所有参数
+  * @retval RT_EOK 成功
+  */
+static rt_err_t log_init(void)
+{
+    uint32_t need = 0;
+
+    par_log.sector_size = uparam_part_sector_size(par_part);
+    if (par_log.sector_size == 0)
+    {
+        LOG_E("Uparam flash device of the partition not found!");
+        return RT_ERROR;
+    }
+    par_log.sector_num = uparam_part_len(par_part) / par_log.sector_size;
+    par_log.head = par_log.sector_num;
+    if (par_log.sector_num < 3)
+    {
+        LOG_E("Uparam log needs at least 3 sectors!");
+        return RT_ERROR;
+    }
+    par_log.erase_cnt = (uint32_t *)UPARAM_MALLOC(par_log.sector_num * sizeof(uint32_t) * 2);
+    if (par_log.erase_cnt == RT_NULL)
+    {
+        return RT_ERROR;
+    }
+    memset(par_log.erase_cnt, 0, par_log.sector_num * sizeof(uint32_t) * 2);
+    par_log.sector_seq = par_log.erase_cnt + par_log.sector_num;
+
+    for (int li = 0; li < param_index; li++)
+    {
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            uint32_t rsize = LOG_RECORD_SIZE(ls[li].par_list_add[i].size);
+            //一条记录不能跨扇区
+            if (rsize > par_log.sector_size - LOG_DATA_START)
+            {
+                LOG_E("Uparam param too large for log sector, list: %d, index: %d", li, i);
+                return RT_ERROR;
+            }
+            need += rsize;
+        }
+    }
+    if (need > (par_log.sector_num - 2) * (par_log.sector_size - LOG_DATA_START))
+    {
+        LOG_E("Uparam log partition is too small, need: %d", need);
+        return RT_ERROR;
+    }
+    return RT_EOK;
+}
+
+uint32_t uparam_log_sector_num(void)
+{
+    return par_log.sector_num;
+}
+
+uint32_t uparam_log_erase_count(uint32_t sector)
+{
+    return (sector < par_log.sector_num && par_log.erase_cnt != RT_NULL) ? par_log.erase_cnt[sector] : 0;
+}
+#endif
+
+/**
+  * @brief  uparam_readall
+  * @note   从flash读取所有参数到内存
+  * @retval 读取成功的参数个数
+  */
+static uint16_t uparam_readall()
+{
+    uint16_t cnt;
+    uint32_t start = stats_clock();
+
+#ifdef UPARAM_USING_LOG
+    cnt = log_readall();
+#else
+    //没有参数表的存储区不用加载
+    cnt = 0;
+    for (uint8_t s = 0; s < store_num && uparam_build_index() == RT_EOK; s++)
+    {
+        if (stores[s].header.cnt.u32 > 0)
+        {
+            store_select(s);
+            cnt += store->counter ? counter_readall() : image_readall();
+        }
+    }
+    store_select(0);
+#endif
+    stats_time(&stats.load, start);
+    stats_set(load_params, cnt);
+    return cnt;
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  store_writeall
+  * @note   把一个存储区里修改过的参数写入到flash
+  * @param  s: 存储区
+  * @retval 写入的参数个数, 失败返回0
+  */
+static uint16_t store_writeall(uint8_t s)
+{
+    uint16_t cnt;
+
+    store_select(s);
+    if (store->counter)
+    {
+        //计数器只追加记录, 保存期间持有写者锁
+        param_lock();
+        cnt = counter_writeall();
+        param_unlock();
+    }
+    else
+    {
+#ifdef UPARAM_USING_LOCK
+        flush_snapshot_take();
+        cnt = image_writeall();
+        flush_snapshot_release(cnt > 0);
+#else
+        cnt = image_writeall();
+#endif
+    }
+    store_select(0);
+    return cnt;
+}
+#endif
+
+/**
+  * @brief  uparam_writeall
+  * @note   将修改过的参数写入到flash, 镜像模式下依次保存每个存储区
+  * @retval 写入的参数个数, 有存储区失败时返回0
+  */
+static uint16_t uparam_writeall()
+{
+    uint16_t cnt;
+    uint32_t start = stats_clock();
+
+#ifdef UPARAM_USING_LOG
+    //日志模式逐个参数比较和追加, 保存期间一直持有写者锁
+    param_lock();
+    cnt = log_writeall();
+    param_unlock();
+#else
+    uint8_t failed = (uparam_build_index() != RT_EOK);
+
+    //一个存储区失败时其他存储区照常保存
+    cnt = 0;
+    for (uint8_t s = 0; s < store_num && addr_index != RT_NULL; s++)
+    {
+        if (stores[s].header.cnt.u32 > 0)
+        {
+            uint16_t n = store_writeall(s);
+            failed |= (n == 0);
+            cnt += n;
+        }
+    }
+    if (failed)
+    {
+        cnt = 0;
+    }
+#endif
+    stats_time(&stats.flush, start);
+    return cnt;
+}
+
+/**
+  * @brief  uparam_reload
+  * @note   重新从flash加载所有参数
+  * @retval 读取成功的参数个数
+  */
+uint16_t uparam_reload(void)
+{
+    uint16_t cnt;
+
+    if (par_part == RT_NULL)
+    {
+        return 0;
+    }
+    storage_lock();
+    param_lock();
+    cnt = uparam_readall();
+    param_unlock();
+    storage_unlock();
+    notify_request();
+
+    return cnt;
+}
+
+/**
+  * @brief  uparam_flush
+  * @note   在当前线程把修改过的参数写入flash
+  * @retval 写入的参数个数
+  */
+uint16_t uparam_flush()
+{
+    uint16_t cnt;
+
+    if (par_part == RT_NULL)
+    {
+        return 0;
+    }
+    storage_lock();
+    cnt = uparam_writeall();
+    storage_unlock();
+
+    return cnt;
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  list_store_set
+  * @note   记录参数表所在的存储区, 一个存储区只能是镜像或者计数器中的一种
+  * @param  counter: 计数器存储区
+  * @retval RT_EOK 成功
+  */
+static rt_err_t list_store_set(param_list *list, const char *part, uint32_t offset, uint32_t len, uint8_t counter)
+{
+    uint8_t s, k;
+
+    if (list == RT_NULL || part == RT_NULL)
+    {
+        return -RT_EINVAL;
+    }
+    if (write_protect)
+    {
+        LOG_E("param list store must be set before uparam_init");
+        return -RT_ERROR;
+    }
+    stores[0].part_name = praram_partition;
+    for (s = 0; s < store_num; s++)
+    {
+        if (!strcmp(stores[s].part_name, part) && stores[s].offset == offset)
+        {
+            break;
+        }
+    }
+    if (s == store_num && store_num >= UPARAM_STORE_MAX)
+    {
+        LOG_E("param store is full, max: %d", UPARAM_STORE_MAX);
+        return -RT_ERROR;
+    }
+    if ((s < store_num && stores[s].counter != counter) || (s == 0 && counter))
+    {
+        LOG_E("param counter and image can't share the store: %s, offset: %d", part, offset);
+        return -RT_ERROR;
+    }
+    for (k = 0; k < store_list_num && store_lists[k].list != list; k++)
+    {
+    }
+    if (k == UPARAM_STORE_LIST_MAX)
+    {
+        LOG_E("param list store is full, max: %d", UPARAM_STORE_LIST_MAX);
+        return -RT_ERROR;
+    }
+    if (s == store_num)
+    {
+        stores[s].part_name = part;
+        stores[s].offset = offset;
+        stores[s].counter = counter;
+        store_num++;
+    }
+    if (stores[s].len == 0)
+    {
+        stores[s].len = len;
+    }
+    store_lists[k].list = list;
+    store_lists[k].store = s;
+    if (k == store_list_num)
+    {
+        store_list_num++;
+    }
+    uparam_index_reset();
+    LOG_D("param list 0x%X saved in %s, offset: %d", (uint32_t)(rt_ubase_t)list, part, offset);
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_set_list_store
+  * @note   指定参数表保存的存储区, 分区和开始位置相同的参数表在同一个存储区, 和默认分区的开始位置相同时就是默认存储区.
+  *         默认存储区到同一分区里下一个存储区的开始位置为止. 要在 uparam_init 前调用
+  * @param  *list: 参数表
+  * @param  *part: 分区名称
+  * @param  offset: 在分区里的开始位置, 按扇区对齐
+  * @param  len: 长度, 按扇区对齐, 0为到分区结尾
+  * @retval RT_EOK 成功, 已经初始化或者存储区已满返回 -RT_ERROR
+  */
+rt_err_t uparam_set_list_store(param_list *list, const char *part, uint32_t offset, uint32_t len)
+{
+    return list_store_set(list, part, offset, len, 0);
+}
+
+/**
+  * @brief  uparam_set_list_counter
+  * @note   参数表保存在计数器存储区, 不进镜像. 每次增加只在当前扇区追加一条记录, 扇区写满后
+  *         擦除最旧的扇区, 写入所有计数器的快照后继续追加, 所有扇区轮流擦写.
+  *         表里只能是4或8字节的'u'类型参数, 存储区至少两个扇区. 要在 uparam_init 前调用
+  * @param  *list: 参数表
+  * @param  *part: 分区名称
+  * @param  offset: 在分区里的开始位置, 按扇区对齐, 不能和默认存储区相同
+  * @param  len: 长度, 按扇区对齐, 0为到分区结尾
+  * @retval RT_EOK 成功, 已经初始化、存储区已满或者和镜像存储区相同返回 -RT_ERROR
+  */
+rt_err_t uparam_set_list_counter(param_list *list, const char *part, uint32_t offset, uint32_t len)
+{
+    return list_store_set(list, part, offset, len, 1);
+}
+
+/**
+  * @brief  store_init
+  * @note   查找每个存储区的分区, 检查对齐和是否重叠
+  * @retval RT_EOK 成功
+  */
+static rt_err_t store_init(void)
+{
+    stores[0].part_name = praram_partition;
+    for (uint8_t s = 0; s < store_num; s++)
+    {
+        param_store_struct *st = &stores[s];
+
+        st->part = (s == 0) ? par_part : uparam_part_find(st->part_name);
+        if (st->part == RT_NULL)
+        {
+            LOG_E("Uparam partition (%s) find error!", st->part_name);
+            return RT_ERROR;
+        }
+        if (st->len == 0 && st->offset < uparam_part_len(st->part))
+        {
+            st->len = uparam_part_len(st->part) - st->offset;
+        }
+        st->version = IMAGE_FORMAT;
+        st->crc_slots = UPARAM_CRC_SLOTS;
+    }
+    for (uint8_t s = 0; s < store_num; s++)
+    {
+        param_store_struct *st = &stores[s];
+        uint32_t sector = uparam_part_sector_size(st->part);
+
+        if (sector == 0)
+        {
+            LOG_E("Uparam store (%s) flash device not found!", st->part_name);
+            return RT_ERROR;
+        }
+        for (uint8_t t = 1; t < store_num; t++)
+        {
+            //没有指定长度的默认存储区到下一个存储区为止
+            if (s == 0 && stores[t].part == st->part && stores[t].offset > st->offset &&
+                stores[t].offset < st->offset + st->len && st->len == uparam_part_len(st->part) - st->offset)
+            {
+                st->len = stores[t].offset - st->offset;
+            }
+        }
+        if (st->offset % sector != 0 || st->len % sector != 0 || st->len == 0 ||
+            st->offset + st->len > uparam_part_len(st->part))
+        {
+            LOG_E("Uparam store (%s) offset: %d, len: %d invalid!", st->part_name, st->offset, st->len);
+            return RT_ERROR;
+        }
+    }
+    for (uint8_t s = 0; s < store_num; s++)
+    {
+        for (uint8_t t = s + 1; t < store_num; t++)
+        {
+            if (stores[s].part == stores[t].part && stores[s].offset < stores[t].offset + stores[t].len &&
+                stores[t].offset < stores[s].offset + stores[s].len)
+            {
+                LOG_E("Uparam store (%s) %d and %d overlap!", stores[s].part_name, stores[s].offset, stores[t].offset);
+                return RT_ERROR;
+            }
+        }
+    }
+    for (uint8_t s = 1; s < store_num; s++)
+    {
+        store_select(s);
+        if (store->counter && (uparam_build_index() != RT_EOK || counter_check() != RT_EOK))
+        {
+            store_select(0);
+            return RT_ERROR;
+        }
+    }
+    store_select(0);
+
+    return RT_EOK;
+}
+#else
+rt_err_t uparam_set_list_store(param_list *list, const char *part, uint32_t offset, uint32_t len)
+{
+    LOG_E("log mode saves all param lists in one partition");
+    return -RT_ERROR;
+}
+
+rt_err_t uparam_set_list_counter(param_list *list, const char *part, uint32_t offset, uint32_t len)
+{
+    LOG_E("log mode saves all param lists in one partition, use uparam_counter_add directly");
+    return -RT_ERROR;
+}
+#endif
+
+/**
+  * @brief  uparam_flush_list
+  * @note   在当前线程只保存参数表所在的存储区, 其他存储区的修改留到下次保存.
+  *         日志模式只有一个存储区, 和 uparam_flush 相同
+  * @param  *list: 参数表
+  * @retval 写入的参数个数, 参数表不存在返回0
+  */
+uint16_t uparam_flush_list(param_list *list)
+{
+#ifdef UPARAM_USING_LOG
+    return uparam_flush();
+#else
+    uint16_t cnt = 0;
+    uint32_t start;
+
+    if (par_part == RT_NULL)
+    {
+        return 0;
+    }
+    storage_lock();
+    start = stats_clock();
+    for (int li = 0; li < param_index && uparam_build_index() == RT_EOK; li++)
+    {
+        if (ls[li].par_list_add == list)
+        {
+            cnt = store_writeall(list_store[li]);
+            break;
+        }
+    }
+    stats_time(&stats.flush, start);
+    storage_unlock();
+
+    return cnt;
+#endif
+}
+
+/**
+  * @brief  uparam_counter_add
+  * @note   计数器加n并立即保存. 计数器存储区只追加一条记录, 扇区写满时才擦除下一个扇区;
+  *         日志模式本身就是追加写入, 只追加这个计数器的记录. 写入失败时内存里已经加上, 留到下次保存
+  * @param  *address: 计数器地址
+  * @param  n: 增加的值
+  * @retval RT_EOK 成功, -RT_EINVAL 不是计数器, -RT_ERROR 不存在或者写入失败
+  */
+rt_err_t uparam_counter_add(void *address, uint32_t n)
+{
+    param_addr_index_struct *found;
+    rt_err_t result = RT_EOK;
+    uint16_t li, i;
+    uint32_t g;
+
+    if (par_part == RT_NULL || uparam_build_index() != RT_EOK)
+    {
+        return -RT_ERROR;
+    }
+    found = find_param_by_address((uint32_t)(rt_ubase_t)address, 0);
+    if (found == RT_NULL)
+    {
+        LOG_W("param is not exist, address: 0x%X", (uint32_t)(rt_ubase_t)address);
+        return -RT_ERROR;
+    }
+    li = found->list;
+    i = found->index;
+    g = PAR_G(li, i);
+#ifdef UPARAM_USING_LOG
+    if (!counter_valid(g))
+#else
+    if (!stores[list_store[li]].counter)
+#endif
+    {
+        LOG_W("param %s is not a counter", ls[li].par_list_add[i].name);
+        return -RT_EINVAL;
+    }
+
+    storage_lock();
+    param_lock();
+    seq_begin();
+    counter_set(g, counter_get(g) + n);
+    seq_end();
+    ls[li].dirty[i / 8] |= 1 << (i % 8);
+#ifdef UPARAM_USING_LOG
+    if (log_write_param(li, i) != RT_EOK)
+    {
+        result = -RT_ERROR;
+    }
+#else
+    store_select(list_store[li]);
+    if (counter_put(li, i) != RT_EOK)
+    {
+        result = -RT_ERROR;
+    }
+    store_select(0);
+#endif
+    param_unlock();
+    storage_unlock();
+    notify_mark(li, i);
+    notify_request();
+
+    return result;
+}
+
+#ifdef UPARAM_USING_ASYNC_FLUSH
+/**
+  * @brief  flush_thread_entry
+  * @note   后台保存线程, 收到请求后等到防抖时间内没有新的请求再保存,
+  *         保存期间来的请求会在下一轮处理
+  * @retval None
+  */
+static void flush_thread_entry(void *param)
+{
+    uint32_t target, waiters;
+    rt_base_t level;
+    uint8_t failed;
+
+    while (1)
+    {
+        uparam_sem_take(flush_req_sem, -1);
+
+#if UPARAM_FLUSH_DEBOUNCE_MS > 0
+        uint32_t gen, delay = 0;
+        do
+        {
+            gen = flush_req_gen;
+            uparam_delay_ms(UPARAM_FLUSH_DEBOUNCE_MS);
+            delay += UPARAM_FLUSH_DEBOUNCE_MS;
+        } while (gen != flush_req_gen && delay < UPARAM_FLUSH_MAX_DELAY_MS);
+#endif
+
+        //从这里开始的请求需要再保存一次
+        level = uparam_irq_lock();
+        target = flush_req_gen;
+        flush_pending = 0;
+        uparam_irq_unlock(level);
+
+        failed = (uparam_flush() == 0);
+
+        level = uparam_irq_lock();
+        flush_done_gen = target;
+        flush_done_failed = failed;
+        waiters = flush_waiters;
+        flush_waiters = 0;
+        uparam_irq_unlock(level);
+        while (waiters--)
+        {
+            uparam_sem_release(flush_done_sem);
+        }
+    }
+}
+
+/**
+  * @brief  uparam_flush_thread_init
+  * @note   创建后台保存线程, 只创建一次
+  * @retval RT_EOK 成功
+  */
+static rt_err_t uparam_flush_thread_init(void)
+{
+    if (flush_req_sem != RT_NULL)
+    {
+        return RT_EOK;
+    }
+    flush_done_sem = uparam_sem_create("par_done");
+    flush_req_sem = uparam_sem_create("par_req");
+    if (flush_lock == RT_NULL || flush_done_sem == RT_NULL || flush_req_sem == RT_NULL)
+    {
+        LOG_E("Uparam flush thread init failed!");
+        flush_req_sem = RT_NULL;
+        return RT_ERROR;
+    }
+    if (uparam_thread_start("par_flush", flush_thread_entry, RT_NULL,
+                            UPARAM_FLUSH_THREAD_STACK, UPARAM_FLUSH_THREAD_PRIORITY) != RT_EOK)
+    {
+        LOG_E("Uparam flush thread start failed!");
+        flush_req_sem = RT_NULL;
+        return RT_ERROR;
+    }
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_flush_async
+  * @note   请求后台线程保存, 只置标志和释放信号量, 不会阻塞, 可以在中断里调用.
+  *         后台线程处理前的多次请求只释放一次信号量
+  * @retval RT_EOK 成功, 后台线程没有运行时返回 -RT_ERROR
+  */
+rt_err_t uparam_flush_async(void)
+{
+    rt_base_t level;
+    uint8_t wake;
+
+    if (flush_req_sem == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    level = uparam_irq_lock();
+    flush_req_gen++;
+    wake = !flush_pending;
+    flush_pending = 1;
+    uparam_irq_unlock(level);
+    if (wake)
+    {
+        uparam_sem_release(flush_req_sem);
+    }
+
+    return RT_EOK;
+}
+
+/**
+  * @brief  uparam_flush_wait
+  * @note   等待调用前发出的保存请求都写入flash, 不能在中断里调用
+  * @param  timeout: 每次等待的超时时间, 单位ms, 小于0时一直等待
+  * @retval RT_EOK 完成, -RT_ETIMEOUT 超时, -RT_ERROR 最近完成的一次保存写入失败
+  */
+rt_err_t uparam_flush_wait(int32_t timeout)
+{
+    uint32_t target;
+    rt_base_t level;
+    rt_err_t result;
+
+    if (flush_req_sem == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    level = uparam_irq_lock();
+    target = flush_req_gen;
+    while ((int32_t)(flush_done_gen - target) < 0)
+    {
+        flush_waiters++;
+        uparam_irq_unlock(level);
+        if (uparam_sem_take(flush_done_sem, timeout) != RT_EOK)
+        {
+            level = uparam_irq_lock();
+            //超时的同时后台线程可能已经完成并释放了信号量, 多出来的信号量只会让别的等待者多检查一次
+            if (flush_waiters > 0)
+            {
+                flush_waiters--;
+            }
+            if ((int32_t)(flush_done_gen - target) < 0)
+            {
+                uparam_irq_unlock(level);
+                return -RT_ETIMEOUT;
+            }
+            break;
+        }
+        level = uparam_irq_lock();
+    }
+    //之后的保存成功时会把之前失败的修改一起写入, 只看最近一次的结果
+    result = flush_done_failed ? -RT_ERROR : RT_EOK;
+    uparam_irq_unlock(level);
+
+    return result;
+}
+#endif
+
+#ifdef UPARAM_USING_NOTIFY
+/**
+  * @brief  subscriber_add
+  * @note   添加订阅者
+  * @retval RT_EOK 成功
+  */
+static rt_err_t subscriber_add(uint16_t list, uint16_t index, uparam_notify_fn fn, void *user)
+{
+    param_subscriber_struct *new_sub;
+    rt_err_t result = RT_EOK;
+
+    if (notify_lock != RT_NULL)
+    {
+        uparam_mutex_lock(notify_lock);
+    }
+    new_sub = (param_subscriber_struct *)UPARAM_REALLOC(subscribers, (subscriber_num + 1) * sizeof(param_subscriber_struct));
+    if (new_sub != RT_NULL)
+    {
+        subscribers = new_sub;
+        subscribers[subscriber_num].fn = fn;
+        subscribers[subscriber_num].user = user;
+        subscribers[subscriber_num].list = list;
+        subscribers[subscriber_num].index = index;
+        subscriber_num++;
+    }
+    else
+    {
+        LOG_E("uparam realloc memory failed");
+        result = -RT_ERROR;
+    }
+    if (notify_lock != RT_NULL)
+    {
+        uparam_mutex_unlock(notify_lock);
+    }
+    return result;
+}
+
+/**
+  * @brief  uparam_subscribe
+  * @note   订阅单个参数的修改通知
+  * @param  *address: 参数地址
+  * @param  fn: 回调, 在通知线程里执行
+  * @param  *user: 传给回调的参数
+  * @retval RT_EOK 成功, -RT_ERROR 参数不存在, -RT_EINVAL 回调为空
+  */
+rt_err_t uparam_subscribe(void *address, uparam_notify_fn fn, void *user)
+{
+    param_addr_index_struct *found;
+
+    if (fn == RT_NULL)
+    {
+        return -RT_EINVAL;
+    }
+    if (uparam_build_index() != RT_EOK ||
+        (found = find_param_by_address((uint32_t)(rt_ubase_t)address, 0)) == RT_NULL)
+    {
+        LOG_W("param is not exist, address: 0x%X", (uint32_t)(rt_ubase_t)address);
+        return -RT_ERROR;
+    }
+    return subscriber_add(found->list, found->index, fn, user);
+}
+
+/**
+  * @brief  uparam_subscribe_list
+  * @note   订阅参数表的修改通知, 一批修改里表内有参数修改时调用一次
+  * @param  *list: 已经添加的参数表
+  * @retval RT_EOK 成功, -RT_ERROR 参数表不存在, -RT_EINVAL 回调为空
+  */
+rt_err_t uparam_subscribe_list(param_list *list, uparam_notify_fn fn, void *user)
+{
+    if (fn == RT_NULL)
+    {
+        return -RT_EINVAL;
+    }
+    for (int li = 0; li < param_index; li++)
+    {
+        if (ls[li].par_list_add == list)
+        {
+            return subscriber_add(li, UPARAM_NOTIFY_LIST, fn, user);
+        }
+    }
+    LOG_W("param list is not exist, address: 0x%X", (uint32_t)(rt_ubase_t)list);
+    return -RT_ERROR;
+}
+
+/**
+  * @brief  uparam_unsubscribe
+  * @note   取消fn和user相同的所有订阅, 不能在回调里调用
+  * @retval None
+  */
+void uparam_unsubscribe(uparam_notify_fn fn, void *user)
+{
+    uint32_t keep = 0;
+
+    if (notify_lock != RT_NULL)
+    {
+        uparam_mutex_lock(notify_lock);
+    }
+    for (uint32_t n = 0; n < subscriber_num; n++)
+    {
+        if (subscribers[n].fn != fn || subscribers[n].user != user)
+        {
+            subscribers[keep++] = subscribers[n];
+        }
+    }
+    subscriber_num = keep;
+    if (notify_lock != RT_NULL)
+    {
+        uparam_mutex_unlock(notify_lock);
+    }
+}
+
 /**
-  * @brief  uparam_add_list
-  * @note   添加参数表
-  * @param  *list_address: 参数表地址
-  * @param  list_size:   包含参数的个数
-  * @retval 
+  * @brief  uparam_notify_dispatch
+  * @note   取出所有已修改的标记作为一批, 逐个调用订阅者. 回调期间新的修改留到下一批
+  * @retval None
   */
-rt_err_t uparam_add_list(param_list *list_address, uint16_t list_size)
+void uparam_notify_dispatch(void)
 {
-    param_list *pa_this;
+    rt_base_t level;
+    uint8_t any = 0;
 
-    //先遍历一下参数表是否已经添加过
-    for (int i = 0; i < param_index; i++)
+    if (notify_lock != RT_NULL)
+    {
+        uparam_mutex_lock(notify_lock);
+    }
+    for (int li = 0; li < param_index; li++)
     {
-        pa_this = (param_list *)ls[i].par_list_add;
+        uint16_t bit_num = UPARAM_BIT_BYTES(ls[li].par_list_size);
 
-        if (pa_this == list_address)
+        level = uparam_irq_lock();
+        for (int b = 0; b < bit_num; b++)
         {
-            LOG_E("param list is exist, address: 0x%X", (uint32_t)list_address);
-            return RT_ERROR;
+            ls[li].notifying[b] = ls[li].changed[b];
+            ls[li].changed[b] = 0;
+            any |= ls[li].notifying[b];
         }
+        uparam_irq_unlock(level);
     }
 
-    //分配内存
-    param_struct *new_ls = (param_struct *)rt_realloc(ls, (param_index + 1) * sizeof(param_struct));
-
-    if (new_ls != RT_NULL)
+    for (uint32_t n = 0; n < subscriber_num && any; n++)
     {
-        ls = new_ls;
-        ls[param_index].par_list_add = (uint32_t)list_address;
-        ls[param_index].par_list_size = list_size;
+        param_subscriber_struct *sub = &subscribers[n];
+        const param_struct *l = &ls[sub->list];
 
-        //按位标记参数是否有效
-
-        uint16_t bit_num = (list_size % 8 == 0) ? (list_size / 8) : (list_size / 8 + 1);
-        ls[param_index].read_valid = (uint8_t *)rt_malloc(bit_num);
-        memset(ls[param_index].read_valid, 0, bit_num);
-        param_index++;
-
-        for (int i = 0; i < list_size; i++)
+        if (sub->index == UPARAM_NOTIFY_LIST)
+        {
+            uint16_t bit_num = UPARAM_BIT_BYTES(l->par_list_size);
+            for (int b = 0; b < bit_num; b++)
+            {
+                if (l->notifying[b])
+                {
+                    sub->fn(l->par_list_add, sub->user);
+                    break;
+                }
+            }
+        }
+        else if (l->notifying[sub->index / 8] & (1 << (sub->index % 8)))
         {
-            pa_this = list_address + i;
-            param_header.size.u32 += pa_this->size;
-            LOG_D("add param suc,name: %s , address: 0x%X, size: %d", pa_this->name, pa_this->address, pa_this->size);
+            sub->fn(&l->par_list_add[sub->index], sub->user);
         }
-        param_header.cnt.u32 += list_size;
-        LOG_D("add param list success, list size: %d, data size total: %d", list_size, param_header.size.u32);
-        return RT_EOK;
     }
-    else
+    if (notify_lock != RT_NULL)
     {
-        rt_free(ls);
-        LOG_E("uparam realloc memory failed");
+        uparam_mutex_unlock(notify_lock);
     }
-    return RT_ERROR;
 }
 
 /**
-  * @brief  cal_crc
-  * @note   计算校验值
-  * @param  start: 起始值
-  * @param  *buff: 
-  * @param  size: 
-  * @retval 
+  * @brief  notify_thread_entry
+  * @note   通知线程, 被唤醒后把已经积累的修改作为一批通知
+  * @retval None
   */
-static uint8_t cal_crc(uint8_t start, uint8_t *buff, uint16_t size)
+static void notify_thread_entry(void *param)
 {
-    uint8_t check = start;
-    for (int i = 0; i < size; i++)
+    rt_base_t level;
+
+    while (1)
     {
-        check ^= buff[i];
+        uparam_sem_take(notify_sem, -1);
+
+        //从这里开始的修改需要再唤醒一次
+        level = uparam_irq_lock();
+        notify_pending = 0;
+        uparam_irq_unlock(level);
+
+        uparam_notify_dispatch();
     }
-    return check;
 }
 
 /**
-  * @brief  uparam_readall
-  * @note   从flash读取所有参数到内存
-  * @retval 
+  * @brief  uparam_notify_thread_init
+  * @note   丢弃初始化加载产生的标记, 创建通知线程, 只创建一次
+  * @retval RT_EOK 成功
   */
-static uint16_t uparam_readall()
+static rt_err_t uparam_notify_thread_init(void)
 {
-    uint32_t offset = 0;
-    param_header_struct header;
-    uint8_t temp[260];
-    uint16_t read_num = 0; //读成功的数量
-    param_p pa_this;       //当前参数信息
-    param_p *pa_next;      //指向下一组参数的信息
-    uint8_t rsize = sizeof(param_header_struct) + sizeof(param_p);
+    for (int li = 0; li < param_index; li++)
+    {
+        memset(ls[li].changed, 0, UPARAM_BIT_BYTES(ls[li].par_list_size));
+    }
+    if (notify_sem != RT_NULL)
+    {
+        return RT_EOK;
+    }
+    if ((notify_sem = uparam_sem_create("par_ntf")) == RT_NULL)
+    {
+        LOG_E("Uparam notify thread init failed!");
+        return RT_ERROR;
+    }
+    if (uparam_thread_start("par_ntf", notify_thread_entry, RT_NULL,
+                            UPARAM_NOTIFY_THREAD_STACK, UPARAM_NOTIFY_THREAD_PRIORITY) != RT_EOK)
+    {
+        LOG_E("Uparam notify thread start failed!");
+        notify_sem = RT_NULL;
+        return RT_ERROR;
+    }
+
+    return RT_EOK;
+}
+#endif
 
-    write_protect++;
+#ifdef UPARAM_USING_LOCK
+#define DEFAULT_RUN_MAX UPARAM_DEFAULT_RUN_MAX
+#else
+#define DEFAULT_RUN_MAX 0xFFFFFFFF
+#endif
 
-    //read header
-    if (fal_partition_read(par_part, 0, temp, rsize) != rsize)
+/**
+  * @brief  default_copy
+  * @note   复制默认值, 参数内存和默认值都接着上一段时只延长上一段, 断开时才复制.
+  *         打开 UPARAM_USING_LOCK 时复制要关中断, 一段不超过 UPARAM_DEFAULT_RUN_MAX, 只有单个参数时可以超过
+  * @param  *run: 还没复制的一段
+  * @param  *pa: 参数, RT_NULL时复制剩下的一段
+  * @retval None
+  */
+static void default_copy(param_default_run_struct *run, param_list *pa)
+{
+    if (pa != RT_NULL && run->len > 0 && (uint8_t *)pa->address == run->dst + run->len &&
+        (const uint8_t *)pa->default_value == run->src + run->len && run->len + pa->size <= DEFAULT_RUN_MAX)
     {
-        LOG_E("Uparam read header failed!");
-        return 0;
+        run->len += pa->size;
+        return;
     }
-    offset += rsize;
-    memcpy(&header, temp, sizeof(param_header_struct));
-    pa_next = (param_p *)(temp + sizeof(param_header_struct));
-
-    //检查header是否有效
-    uint8_t check = cal_crc(0x55, header.cnt.u8, 4);
-    check = cal_crc(check, header.size.u8, 4);
-    if (header.header != 0x55 || check != header.crc)
+    if (run->len > 0)
     {
-        LOG_E("Uparam header invalid!");
-        return 0;
+        param_write(run->dst, run->src, run->len);
     }
-
-    LOG_D("read param number: %d", header.cnt.u32);
-    if (header.cnt.u32 != param_header.cnt.u32)
+    run->len = 0;
+    if (pa != RT_NULL)
     {
-        LOG_W("param number is changed, the exist is %d", param_header.cnt.u32);
+        run->dst = (uint8_t *)pa->address;
+        run->src = (const uint8_t *)pa->default_value;
+        run->len = pa->size;
     }
+}
+
+/**
+  * @brief  default_call
+  * @note   调用默认值回调. 打开 UPARAM_USING_LOCK 时回调不能在关中断里执行,
+  *         先写到临时缓冲再在写者临界区里复制; 临时缓冲分配失败时直接写参数内存, 读者可能读到一半新一半旧的值
+  * @retval None
+  */
+static void default_call(param_list *pa)
+{
+#ifdef UPARAM_USING_LOCK
+    uint8_t *temp = (pa->size <= sizeof(copy_buf)) ? copy_buf : (uint8_t *)UPARAM_MALLOC(pa->size);
 
-    //循环读取每组参数
-    for (int i = 0; i < header.cnt.u32; i++)
+    if (temp != RT_NULL)
     {
-        //读数据段,长度为数据长度 + 1CRC + 下一组参数信息
-        rsize = pa_next->size + 1 + sizeof(param_p);
-        //这里读取了数据后pa指向的size是下一组数据的size,需要先记录一下当前数据的size不然crc会错误
-        pa_this.size = pa_next->size;
-        pa_this.address = pa_next->address;
-        if (fal_partition_read(par_part, offset, temp, rsize) != rsize)
+        //回调可能只改一部分, 从当前值开始
+        memcpy(temp, pa->address, pa->size);
+        pa->default_fun(temp, pa->size);
+        param_write((uint8_t *)pa->address, temp, pa->size);
+        if (temp != copy_buf)
         {
-            LOG_E("Uparam read data failed!");
-            return 0;
+            UPARAM_FREE(temp);
         }
-        offset += rsize;
+        return;
+    }
+    LOG_W("Uparam malloc copy buffer failed, size: %d", pa->size);
+#endif
+    pa->default_fun(pa->address, pa->size);
+}
 
-        //检查CRC
-        check = cal_crc(0x55, temp, pa_this.size);
+/**
+  * @brief  default_param
+  * @note   还原一个参数到默认值, 有默认值时复制, 否则调用回调
+  * @param  *run: 还没复制的一段, 调用回调前先复制掉
+  * @retval None
+  */
+static void default_param(param_default_run_struct *run, uint16_t li, uint16_t i)
+{
+    param_list *pa = &ls[li].par_list_add[i];
+
+    LOG_D("reset param [%-16s], address: 0x%X, size:%d", pa->name, (uint32_t)(rt_ubase_t)pa->address, pa->size);
+    if (pa->default_value != RT_NULL)
+    {
+        default_copy(run, pa);
+    }
+    else if (pa->default_fun != RT_NULL)
+    {
+        default_copy(run, RT_NULL);
+        default_call(pa);
+    }
+    else
+    {
+        LOG_E("reset error [%-16s], address: 0x%X, default is null", pa->name, (uint32_t)(rt_ubase_t)pa->address);
+        return;
+    }
+    notify_mark(li, i);
+}
+
+/**
+  * @brief  uparam_default
+  * @note   还原参数到默认值. 有地址索引时按地址顺序还原, 参数和默认值都连续存放时整段复制
+  * @retval None
+  */
+static void uparam_default()
+{
+    param_default_run_struct run;
+    uint16_t li = 0, i = 0;
 
-        LOG_D("read param address 0x%X, size:%d, crc:%X, calc:%X", pa_this.address, pa_this.size, check, temp[pa_this.size]);
+    //对新加入的数据执行默认操作
+    LOG_D("Reset changed param to default!");
 
-        if (check != temp[pa_this.size])
+    memset(&run, 0, sizeof(run));
+    //遍历没有读出的数据, 没有地址索引时按参数表的顺序
+    for (uint32_t n = 0; n < param_header.cnt.u32; n++, i++)
+    {
+        if (addr_index != RT_NULL)
         {
-            LOG_E("Uparam check data failed! Index:%d, Address:%X", i, (uint32_t)pa_this.address);
-            return 0;
+            li = addr_index[n].list;
+            i = addr_index[n].index;
         }
-
-        //读成功了，对内存赋值
-        //不要直接赋值，先检查一下是否在参数表里面存在，防止数据地址被修改后写入未知地址
-        param_list *pa_list_t;
-        param_p *pa_t;
-        int li;
-        int idx;
-        for (li = 0; li < param_index; li++)
+        while (i >= ls[li].par_list_size)
         {
-            pa_list_t = (param_list *)ls[li].par_list_add;
-
-            for (idx = 0; idx < ls[li].par_list_size; idx++)
-            {
-                pa_t = (param_p *)&pa_list_t[idx];
-                //是否存在 并且 size相同
-                if (pa_t->address == pa_this.address)
-                {
-                    if (pa_t->size == pa_this.size)
-                    {
-                        //对成功读出的数据标记一下
-                        ls[li].read_valid[idx / 8] |= 1 << idx;
-
-                        //对数据赋读出的值
-                        memcpy((void *)(pa_this.address), temp, pa_this.size);
-                        read_num++;
-                        break;
-                    }
-                    else
-                    {
-                        LOG_W("target size is different, size: %d", pa_t->size);
-                    }
-                }
-            }
-            //找到了
-            if (idx != ls[li].par_list_size)
-            {
-                break;
-            }
+            li++;
+            i = 0;
         }
-        //未找到此参数
-        if (li == param_index)
+        if ((ls[li].read_valid[i / 8] & (1 << (i % 8))) == 0)
         {
-            LOG_W("param is not exist, address: 0x%X ,read size: %d", pa_this.address, pa_this.size);
+            default_param(&run, li, i);
         }
-
-        pa_next = (param_p *)(temp + pa_this.size + 1);
     }
-    LOG_D("read param success count: %d", read_num);
+    default_copy(&run, RT_NULL);
+}
 
-    return read_num;
+/**
+  * @brief  export_put
+  * @note   把一段导出数据交给输出函数, 同时累加CRC
+  * @retval None
+  */
+static void export_put(param_export_out_struct *out, const void *data, uint32_t size)
+{
+    out->crc = uparam_crc32(out->crc, data, size);
+    out->size += size;
+    out->fn((const uint8_t *)data, size, out->user);
 }
 
 /**
-  * @brief  uparam_writeall
-  * @note   将参数表里面所有参数写入到flash
-  * @retval 
+  * @brief  uparam_export
+  * @note   导出参数集: 头部, 每个参数的 ID+长度+数据, 最后是CRC-32. ID和保存到flash的一样,
+  *         导入到重新链接的固件里也能找到. 导出时持有写者锁, 通过接口的修改要等导出完成
+  * @param  *list: 只导出这个参数表, RT_NULL为全部
+  * @param  fn: 输出函数, 数据分段输出
+  * @param  *user: 传给fn
+  * @retval 导出的总字节数, 失败返回0
   */
-static uint16_t uparam_writeall()
+uint32_t uparam_export(param_list *list, uparam_export_fn fn, void *user)
 {
-    uint32_t offset = 0;
-    uint8_t temp[270];
-    param_list *pa_list;
-    param_p *pa;
-    uint8_t wsize = sizeof(param_header_struct);
+    param_export_out_struct out;
+    param_export_struct head;
+    param_p rec;
+    uint16_t first = 0, last = param_index;
+    uint32_t crc;
 
-    if (write_protect < 1)
+    if (fn == RT_NULL || uparam_build_index() != RT_EOK)
     {
-        LOG_E("Uparam should read once before write!");
         return 0;
     }
-
-    //计算要写入的总字节数 header+ 数据头+数据+校验
-    int allsize = wsize + sizeof(param_p) * param_header.cnt.u32 + param_header.size.u32 + param_header.cnt.u32;
-    LOG_D("Uparam write, cnt: %d, data size: %d, all size: %d!", param_header.cnt.u32, param_header.size.u32, allsize);
-
-    //擦除flash
-    fal_partition_erase(par_part, 0, allsize);
-
-    offset = wsize;
-    //循环写入所有参数
-    for (int li = 0; li < param_index; li++)
+    if (list != RT_NULL)
     {
-        pa_list = (param_list *)ls[li].par_list_add;
-
-        for (int i = 0; i < ls[li].par_list_size; i++)
+        for (first = 0; first < param_index && ls[first].par_list_add != list; first++)
         {
-            pa = (param_p *)&pa_list[i];
-
-            memcpy(temp, pa, sizeof(param_p));
-            //准备数据
-            memcpy(temp + sizeof(param_p), (void *)(pa->address), pa->size);
-            temp[sizeof(param_p) + pa->size] = cal_crc(0x55, (uint8_t *)(pa->address), pa->size);
-
-            LOG_D("write [%-16s], size:%d, crc:%X", pa_list[i].name, pa->size, temp[sizeof(param_p) + pa->size]);
-
-            //写入 数据加一字节校验
-            wsize = sizeof(param_p) + pa->size + 1;
-            if (fal_partition_write(par_part, offset, temp, wsize) != wsize)
-            {
-                LOG_E("Uparam write data failed!");
-                return 0;
-            }
-            offset += wsize;
         }
+        if (first >= param_index)
+        {
+            LOG_E("export list is not exist");
+            return 0;
+        }
+        last = first + 1;
     }
 
-    //最后写入header
-    wsize = sizeof(param_header_struct);
-    param_header.header = 0x55;
-    param_header.crc = cal_crc(0x55, param_header.cnt.u8, 4);
-    param_header.crc = cal_crc(param_header.crc, param_header.size.u8, 4);
-    if (fal_partition_write(par_part, 0, (uint8_t *)&param_header, wsize) != wsize)
+    head.magic = UPARAM_EXPORT_MAGIC;
+    head.cnt = list_base[last] - list_base[first];
+    head.size = 0;
+    for (uint32_t g = list_base[first]; g < list_base[last]; g++)
     {
-        LOG_E("Uparam write header failed!");
-        return 0;
+        head.size += par_size[g];
     }
-    LOG_D("Uparam write param, cnt: %d, write size: %d!", param_header.cnt.u32, offset - wsize);
-    return param_header.cnt.u32;
-}
 
-/**
-  * @brief  
-  * @note   
-  * @retval 
-  */
-uint16_t uparam_flush()
-{
-    return uparam_writeall();
+    memset(&out, 0, sizeof(out));
+    out.fn = fn;
+    out.user = user;
+    param_lock();
+    export_put(&out, &head, sizeof(head));
+    for (uint16_t li = first; li < last; li++)
+    {
+        for (uint16_t i = 0; i < ls[li].par_list_size; i++)
+        {
+            rec.id = param_key(li, i);
+            rec.size = par_size[PAR_G(li, i)];
+            export_put(&out, &rec, sizeof(rec));
+            export_put(&out, par_addr[PAR_G(li, i)], rec.size);
+        }
+    }
+    param_unlock();
+    crc = out.crc;
+    export_put(&out, &crc, sizeof(crc));
+
+    return out.size;
 }
 
 /**
-  * @brief  uparam_default
-  * @note   还原参数到默认值
-  * @retval None
+  * @brief  uparam_import
+  * @note   导入 uparam_export 导出的参数集. 先检查CRC和所有记录的长度, 全部正确后在写者锁里
+  *         一次写入所有参数, 其他写者和保存不会看到只导入了一部分的参数. 当前没有或者长度
+  *         不一致的参数跳过
+  * @param  *blob: 导出的数据
+  * @param  size: 数据长度
+  * @param  *applied: 返回写入的参数个数, 可以为RT_NULL
+  * @retval RT_EOK 成功, -RT_EINVAL 数据损坏, -RT_ERROR 索引建立失败
   */
-static void uparam_default()
+rt_err_t uparam_import(const void *blob, uint32_t size, uint32_t *applied)
 {
+    const uint8_t *data = (const uint8_t *)blob;
+    param_export_struct head;
+    param_p rec;
+    uint32_t crc, offset, cnt = 0;
+    uint16_t li, i;
 
-    //对新加入的数据执行默认操作
-    LOG_D("Reset changed param to default!");
+    if (uparam_build_index() != RT_EOK)
+    {
+        return -RT_ERROR;
+    }
+    if (size < sizeof(head) + sizeof(crc))
+    {
+        return -RT_EINVAL;
+    }
+    memcpy(&head, data, sizeof(head));
+    memcpy(&crc, data + size - sizeof(crc), sizeof(crc));
+    size -= sizeof(crc);
+    if (head.magic != UPARAM_EXPORT_MAGIC || uparam_crc32(0, data, size) != crc)
+    {
+        LOG_E("import data is damaged");
+        return -RT_EINVAL;
+    }
 
-    //遍历没有读出的数据
-    param_list *pa_list_t;
-    for (int li = 0; li < param_index; li++)
+    //先检查记录刚好占满数据, 再写入
+    offset = sizeof(head);
+    for (uint32_t n = 0; n < head.cnt; n++)
+    {
+        if (size - offset < sizeof(rec))
+        {
+            break;
+        }
+        memcpy(&rec, data + offset, sizeof(rec));
+        offset += sizeof(rec);
+        if (size - offset < rec.size)
+        {
+            break;
+        }
+        offset += rec.size;
+        cnt++;
+    }
+    if (cnt != head.cnt || offset != size)
     {
-        pa_list_t = (param_list *)ls[li].par_list_add;
+        LOG_E("import data is damaged, record %d of %d", cnt, head.cnt);
+        return -RT_EINVAL;
+    }
 
-        for (int i = 0; i < ls[li].par_list_size; i++)
+    cnt = 0;
+    offset = sizeof(head);
+    param_lock();
+    for (uint32_t n = 0; n < head.cnt; n++)
+    {
+        memcpy(&rec, data + offset, sizeof(rec));
+        offset += sizeof(rec);
+        if (find_param_by_key(rec.id, rec.size, 0, &li, &i))
         {
-            if ((ls[li].read_valid[i / 8] & (1 << i)) == 0)
-            {
-                //
-                LOG_D("reset param [%-16s], address: 0x%X, size:%d", pa_list_t[i].name, pa_list_t[i].address, pa_list_t[i].size);
-                if (pa_list_t[i].default_fun != RT_NULL)
-                {
-                    pa_list_t[i].default_fun(pa_list_t[i].address, pa_list_t[i].size);
-                }
-                else
-                {
-                    LOG_E("reset error [%-16s], address: 0x%X, default_fun is null", pa_list_t[i].name, pa_list_t[i].address);
-                }
-            }
+            seq_begin();
+            memcpy(par_addr[PAR_G(li, i)], data + offset, rec.size);
+            seq_end();
+            ls[li].dirty[i / 8] |= 1 << (i % 8);
+            notify_mark(li, i);
+            cnt++;
+        }
+        else
+        {
+            LOG_W("import param is not exist, id: 0x%X, size: %d", rec.id, rec.size);
         }
+        offset += rec.size;
     }
+    param_unlock();
+    notify_request();
+
+    if (applied != RT_NULL)
+    {
+        *applied = cnt;
+    }
+    return RT_EOK;
 }
 
 /**
@@ -356,57 +5275,74 @@ static void print_list_header()
   * @param  offset: 数组类型的打印起始偏移 
   * @retval None
   */
-static void print_element(param_p *pa, uint32_t index, uint32_t offset)
+static void print_element(param_list *pa, uint32_t index, uint32_t offset)
 {
     uint16_t len;
     char buff[64];
     char value[8];
-    param_list *pa_list = (param_list *)pa;
+    param_list *pa_list = pa;
+    uint8_t *address = (uint8_t *)pa->address;
+    uint16_t size = pa->size;
+    char type = pa->type[0];
+
+    //有运行时索引时从对齐的数组里取, 不用读压缩的参数表
+    if (par_addr != RT_NULL && index < param_header.cnt.u32)
+    {
+        address = par_addr[index];
+        size = par_size[index];
+        type = par_type[index];
+    }
 
     //打印信息
     rt_kprintf("%-5d %-16s 0x%-8X  %-4d  ", index, (const char *)pa_list->name,
-               pa->address, pa->size);
+               (uint32_t)(rt_ubase_t)address, size);
 
     memset(buff, 0, sizeof(buff));
     memset(value, 0, sizeof(value));
 
     //打印数据
-    if (pa_list->type[0] == 'f')
+    if (type == 'f')
     {
-        memcpy(value, (uint8_t *)pa->address, pa->size);
+        memcpy(value, address, size);
         len = sprintf(buff, "Float   %.3f\r\n", *(float *)(value));
     }
-    else if (pa_list->type[0] == 's')
+    else if (type == 's')
     {
-        len = sprintf(buff, "String  %s\r\n", (char *)pa->address);
+        //大的字符串参数只打印开头, 也不要求以0结尾
+        int n = 0;
+        while (n < size && n < 40 && ((char *)address)[n] != '\0')
+        {
+            n++;
+        }
+        len = sprintf(buff, "String  %.*s%s\r\n", n, (char *)address, n == 40 && n < size ? "..." : "");
     }
-    else if (pa_list->type[0] == 'd')
+    else if (type == 'd')
     {
         int64_t convert = 0;
-        if (pa->size == 1)
+        if (size == 1)
         {
-            convert = (int64_t)(*(int8_t *)(pa->address));
+            convert = (int64_t)(*(int8_t *)(address));
         }
-        if (pa->size == 2)
+        if (size == 2)
         {
-            convert = (int64_t)(*(int16_t *)(pa->address));
+            convert = (int64_t)(*(int16_t *)(address));
         }
-        if (pa->size == 4)
+        if (size == 4)
         {
-            convert = (int64_t)(*(int32_t *)(pa->address));
+            convert = (int64_t)(*(int32_t *)(address));
         }
-        if (pa->size == 8)
+        if (size == 8)
         {
-            convert = (int64_t)(*(int64_t *)(pa->address));
+            convert = (int64_t)(*(int64_t *)(address));
         }
-        len = sprintf(buff, "Intger  %lld\r\n", convert);
+        len = sprintf(buff, "Intger  %lld\r\n", (long long)convert);
     }
-    else if (pa_list->type[0] == 'u')
+    else if (type == 'u')
     {
-        memcpy(value, (uint8_t *)pa->address, pa->size);
-        len = sprintf(buff, "UIntger %lld\r\n", *(uint64_t *)(value));
+        memcpy(value, address, size);
+        len = sprintf(buff, "UIntger %llu\r\n", *(unsigned long long *)(value));
     }
-    else if (pa_list->type[0] == 'v')
+    else if (type == 'v')
     {
         //vector 格式,判断下输出形式
         if (pa_list->type[1] == 'b')
@@ -414,9 +5350,9 @@ static void print_element(param_p *pa, uint32_t index, uint32_t offset)
             /**按单字节打印输出 */
             len = sprintf(buff, "V Byte  ");
             //最长只打印5个数字
-            for (int s = 0; s < pa->size && s < 5; s++)
+            for (int s = 0; s < (size - offset) && s < 5; s++)
             {
-                len += sprintf(buff + len, "%02X ", *((uint8_t *)(pa->address) + offset + s));
+                len += sprintf(buff + len, "%02X ", *((uint8_t *)(address) + offset + s));
             }
         }
         else if (pa_list->type[1] == 'w')
@@ -424,9 +5360,9 @@ static void print_element(param_p *pa, uint32_t index, uint32_t offset)
             /**按双字节打印输出 */
             len = sprintf(buff, "V Word  ");
             //最长只打印5个数字
-            for (int s = 0; s < (pa->size / 2 - offset) && s < 5; s++)
+            for (int s = 0; s < (size / 2 - offset) && s < 5; s++)
             {
-                len += sprintf(buff + len, "%04X ", *((uint16_t *)(pa->address) + offset + s));
+                len += sprintf(buff + len, "%04X ", *((uint16_t *)(address) + offset + s));
             }
         }
         else if (pa_list->type[1] == 'd')
@@ -434,9 +5370,9 @@ static void print_element(param_p *pa, uint32_t index, uint32_t offset)
             /**按四字节打印输出 */
             len = sprintf(buff, "V Dword ");
             //最长只打印5个数字
-            for (int s = 0; s < (pa->size / 4 - offset) && s < 5; s++)
+            for (int s = 0; s < (size / 4 - offset) && s < 5; s++)
             {
-                len += sprintf(buff + len, "%08X ", *((uint32_t *)(pa->address) + offset + s));
+                len += sprintf(buff + len, "%08X ", *((uint32_t *)(address) + offset + s));
             }
         }
         else if (pa_list->type[1] == 'f')
@@ -444,39 +5380,84 @@ static void print_element(param_p *pa, uint32_t index, uint32_t offset)
             /**按float打印输出 */
             len = sprintf(buff, "V Float ");
             //最长只打印5个数字
-            for (int s = 0; s < (pa->size / 4 - offset) && s < 5; s++)
+            for (int s = 0; s < (size / 4 - offset) && s < 5; s++)
+            {
+                len += sprintf(buff + len, "%.3f ", *((float *)(address) + offset + s));
+            }
+        }
+        len += sprintf(buff + len, "\r\n");
+    }
+    rt_kprintf("%s", buff);
+}
+
+/**
+  * @brief  uparam_list
+  * @note   打印参数
+  * @retval None
+  */
+static void uparam_list()
+{
+
+    param_list *pa_list;
+    uint32_t index = 0;
+
+    print_list_header();
+    for (int li = 0; li < param_index; li++)
+    {
+        pa_list = ls[li].par_list_add;
+
+        for (int i = 0; i < ls[li].par_list_size; i++)
+        {
+            print_element(&pa_list[i], index++, 0);
+        }
+    }
+}
+
+/**
+  * @brief  param_locate
+  * @note   全局序号换成参数表和表里的序号, 在参数表开始序号的前缀和里二分查找, 没有索引时逐个参数表查找
+  * @param  index: 全局序号
+  * @param  *li: 返回所在参数表
+  * @param  *i: 返回在参数表里的序号
+  * @retval 1 找到, 0 超出范围
+  */
+static int param_locate(uint32_t index, uint16_t *li, uint16_t *i)
+{
+    if (index >= param_header.cnt.u32)
+    {
+        return 0;
+    }
+    if (list_base != RT_NULL)
+    {
+        uint32_t lo = 0, hi = param_index;
+
+        //找最后一个开始序号不大于index的参数表, 空的参数表和下一个的开始序号相同
+        while (hi - lo > 1)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (list_base[mid] <= index)
+            {
+                lo = mid;
+            }
+            else
             {
-                len += sprintf(buff + len, "%.3f ", *((float *)(pa->address) + offset + s));
+                hi = mid;
             }
         }
-        len += sprintf(buff + len, "\r\n");
+        *li = lo;
+        *i = index - list_base[lo];
+        return 1;
     }
-    rt_kprintf("%s", buff);
-}
-
-/**
-  * @brief  uparam_list
-  * @note   打印参数
-  * @retval None
-  */
-static void uparam_list()
-{
-
-    param_list *pa_list;
-    param_p *pa;
-    uint32_t index = 0;
-
-    print_list_header();
-    for (int li = 0; li < param_index; li++)
+    for (*li = 0; *li < param_index; (*li)++)
     {
-        pa_list = (param_list *)ls[li].par_list_add;
-
-        for (int i = 0; i < ls[li].par_list_size; i++)
+        if (index < ls[*li].par_list_size)
         {
-            pa = (param_p *)&pa_list[i];
-            print_element(pa, index++, 0);
+            *i = index;
+            return 1;
         }
+        index -= ls[*li].par_list_size;
     }
+    return 0;
 }
 
 /**
@@ -487,20 +5468,60 @@ static void uparam_list()
  */
 static param_list *find_param_by_index(uint32_t index)
 {
-    uint32_t pre_index = 0;
-    param_list *pa_list;
+    uint16_t li, i;
 
-    for (int li = 0; li < param_index; li++)
+    if (!param_locate(index, &li, &i))
     {
-        pa_list = (param_list *)ls[li].par_list_add;
-        if (index - pre_index < ls[li].par_list_size)
-        {
-            return (pa_list + (index - pre_index));
-        }
-        pre_index += ls[li].par_list_size;
+        return NULL;
+    }
+    return &ls[li].par_list_add[i];
+}
+
+/**
+  * @brief  param_index_by_arg
+  * @note   shell里的参数可以是序号, 也可以是参数名称
+  * @param  *arg: 序号或者名称
+  * @retval 序号, 名称不存在时返回参数总数
+  */
+static uint32_t param_index_by_arg(const char *arg)
+{
+    param_name_index_struct *found;
+    uint32_t index = 0;
+
+    if (arg[0] >= '0' && arg[0] <= '9')
+    {
+        return strtoul(arg, NULL, 0);
+    }
+    if ((found = find_param_by_name(arg)) == RT_NULL)
+    {
+        return param_header.cnt.u32;
+    }
+    if (list_base != RT_NULL)
+    {
+        return PAR_G(found->list, found->index);
+    }
+    for (int li = 0; li < found->list; li++)
+    {
+        index += ls[li].par_list_size;
     }
+    return index + found->index;
+}
 
-    return NULL;
+/**
+  * @brief  param_commit
+  * @note   在写者临界区里写入参数的一段并标记为已修改
+  * @param  offset: 参数内的字节偏移
+  * @param  len: 长度
+  * @retval None
+  */
+static void param_commit(param_list *pa, uint32_t offset, const void *value, uint32_t len)
+{
+    param_lock();
+    seq_begin();
+    memcpy((uint8_t *)pa->address + offset, value, len);
+    seq_end();
+    uparam_set_dirty(pa->address);
+    param_unlock();
 }
 
 /**
@@ -511,13 +5532,19 @@ static param_list *find_param_by_index(uint32_t index)
   */
 static void reset_param_by_index(uint32_t index)
 {
-    param_list *pa_list;
-    pa_list = find_param_by_index(index);
+    param_default_run_struct run;
+    uint16_t li, i;
 
-    if (pa_list->default_fun != RT_NULL)
+    if (!param_locate(index, &li, &i))
     {
-        pa_list->default_fun(pa_list->address, pa_list->size);
+        return;
     }
+
+    memset(&run, 0, sizeof(run));
+    param_lock();
+    default_param(&run, li, i);
+    default_copy(&run, RT_NULL);
+    param_unlock();
 }
 
 /**
@@ -527,28 +5554,72 @@ static void reset_param_by_index(uint32_t index)
   */
 static void erase_all_param(void)
 {
-    //只需要擦除保存的header即可
-    fal_partition_erase(par_part, 0, sizeof(param_header_struct));
+    storage_lock();
+    param_lock();
+#ifdef UPARAM_USING_LOG
+    log_erase_all();
+#else
+    //只需要擦除每个存储区保存的header即可, 计数器存储区每个扇区都有头部, 全部擦除
+    for (uint8_t s = 0; s < store_num; s++)
+    {
+        store_select(s);
+        flash_erase(par_part, 0, store->counter ? store->len : sizeof(param_header_struct));
+        store->match = 0;
+        store->crc_slots = UPARAM_CRC_SLOTS;
+        store->ring_pos = 0;
+    }
+    store_select(0);
+#endif
 
     //清除参数读取标志
     for (int li = 0; li < param_index; li++)
     {
-        uint16_t bit_num = (ls[li].par_list_size % 8 == 0) ? (ls[li].par_list_size / 8) : (ls[li].par_list_size / 8 + 1);
+        uint16_t bit_num = UPARAM_BIT_BYTES(ls[li].par_list_size);
         memset(ls[li].read_valid, 0, bit_num);
     }
     //初始化参数到默认值
     uparam_default();
+    param_unlock();
+    storage_unlock();
+    notify_request();
+}
+
+#ifndef UPARAM_USING_LOG
+/**
+  * @brief  store_format_changed
+  * @note   有存储区加载的镜像格式和保存的格式不同, 需要重写
+  * @retval 1 需要重写
+  */
+static int store_format_changed(void)
+{
+    int changed = 0;
+
+    for (uint8_t s = 0; s < store_num; s++)
+    {
+        if (stores[s].header.cnt.u32 > 0 && stores[s].version != IMAGE_FORMAT)
+        {
+            LOG_I("Uparam image format 0x%02X, rewrite as 0x%02X", stores[s].version, IMAGE_FORMAT);
+            changed = 1;
+        }
+    }
+    return changed;
 }
+#endif
 
 /**
   * @brief  uparam_init
   * @note   初始化参数
   * @retval 
   */
-static int uparam_init(void)
+int uparam_init(void)
 {
+    uint32_t start = stats_clock();
+
+#ifdef UPARAM_USING_SECTION
+    uparam_section_load();
+#endif
     /* 寻找参数分区是否存在 */
-    if ((par_part = fal_partition_find(praram_partition)) == RT_NULL)
+    if ((par_part = uparam_part_find(praram_partition)) == RT_NULL)
     {
         LOG_E("Uparam init failed! Partition (%s) find error!", praram_partition);
         RT_ASSERT(RT_ERROR);
@@ -561,25 +5632,290 @@ static int uparam_init(void)
         return RT_EOK;
     }
 
+    if (uparam_lock_init() != RT_EOK)
+    {
+        LOG_E("Uparam lock init failed!");
+        par_part = RT_NULL;
+        return RT_ERROR;
+    }
+
+#ifndef UPARAM_USING_LOG
+    if (store_init() != RT_EOK)
+    {
+        LOG_E("Uparam store init failed!");
+        par_part = RT_NULL;
+        return RT_ERROR;
+    }
+#endif
+#ifdef UPARAM_USING_LOG
+    if (log_init() != RT_EOK)
+    {
+        LOG_E("Uparam log init failed!");
+        par_part = RT_NULL;
+        return RT_ERROR;
+    }
+#endif
+
     //加载参数失败
+    param_lock();
     if (uparam_readall() < param_header.cnt.u32)
     {
         LOG_W("Uparam read failed, reset to default!");
         //初始化参数到默认值
         uparam_default();
+        param_unlock();
 
         //重新写入参数
         uparam_writeall();
     }
+#ifndef UPARAM_USING_LOG
+    else if (store_format_changed())
+    {
+        param_unlock();
+        uparam_writeall();
+    }
+#else
+    else if (par_log.legacy)
+    {
+        param_unlock();
+        LOG_I("Uparam log has legacy sectors, rewrite all records");
+        uparam_writeall();
+    }
+#endif
+    else
+    {
+        param_unlock();
+    }
+
+#ifdef UPARAM_USING_ASYNC_FLUSH
+    uparam_flush_thread_init();
+#endif
+#ifdef UPARAM_USING_NOTIFY
+    uparam_notify_thread_init();
+#endif
+    stats_time(&stats.init, start);
 
     return RT_EOK;
 }
 
-INIT_COMPONENT_EXPORT(uparam_init);
+UPARAM_INIT_EXPORT(uparam_init);
 //INIT_ENV_EXPORT
 
 #ifdef UPARAM_FINSH
-#include <finsh.h>
+
+static const char base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* shell导入的暂存区, 不在导入时buf为RT_NULL */
+static param_text_struct import_text;
+
+/**
+  * @brief  text_value
+  * @note   十六进制或者base64字符的值
+  * @retval 字符的值, 不是合法字符返回-1
+  */
+static int text_value(param_text_struct *t, char c)
+{
+    const char *pos;
+
+    if (t->bits == 4)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            return (c | 0x20) - 'a' + 10;
+        }
+        return -1;
+    }
+    pos = strchr(base64_table, c);
+    return (pos != RT_NULL && c != '\0') ? pos - base64_table : -1;
+}
+
+/**
+  * @brief  text_put
+  * @note   输出一个编码后的字符, 一行满了打印成一条导入命令
+  * @retval None
+  */
+static void text_put(param_text_struct *t, char c)
+{
+    t->line[t->line_len++] = c;
+    t->chars++;
+    if (t->line_len >= UPARAM_EXPORT_LINE_CHARS)
+    {
+        t->line[t->line_len] = '\0';
+        rt_kprintf("par import %s\r\n", t->line);
+        t->line_len = 0;
+    }
+}
+
+/**
+  * @brief  export_text
+  * @note   uparam_export 的输出函数, 按十六进制或者base64编码
+  * @retval None
+  */
+static void export_text(const uint8_t *data, uint32_t size, void *user)
+{
+    param_text_struct *t = (param_text_struct *)user;
+    uint32_t mask = (1 << t->bits) - 1;
+
+    for (uint32_t n = 0; n < size; n++)
+    {
+        t->acc = (t->acc << 8) | data[n];
+        t->acc_bits += 8;
+        while (t->acc_bits >= t->bits)
+        {
+            t->acc_bits -= t->bits;
+            text_put(t, t->bits == 4 ? "0123456789ABCDEF"[(t->acc >> t->acc_bits) & mask] : base64_table[(t->acc >> t->acc_bits) & mask]);
+        }
+    }
+}
+
+/**
+  * @brief  export_text_finish
+  * @note   输出剩下的位, base64补齐到4个字符, 打印最后一行
+  * @retval None
+  */
+static void export_text_finish(param_text_struct *t)
+{
+    if (t->acc_bits > 0)
+    {
+        text_put(t, base64_table[(t->acc << (t->bits - t->acc_bits)) & ((1 << t->bits) - 1)]);
+        t->acc_bits = 0;
+    }
+    while (t->bits == 6 && t->chars % 4 != 0)
+    {
+        text_put(t, '=');
+    }
+    if (t->line_len > 0)
+    {
+        t->line[t->line_len] = '\0';
+        rt_kprintf("par import %s\r\n", t->line);
+        t->line_len = 0;
+    }
+}
+
+/**
+  * @brief  import_byte
+  * @note   解码出的一个字节放进暂存区, 收到头部后按总长度分配暂存区
+  * @retval None
+  */
+static void import_byte(param_text_struct *t, uint8_t byte)
+{
+    if (t->len >= t->cap)
+    {
+        param_export_struct head;
+        uint64_t total;
+        uint8_t *buf;
+
+        if (t->cap != sizeof(head))
+        {
+            rt_kprintf("import data is too long\r\n");
+            t->error = 1;
+            return;
+        }
+        memcpy(&head, t->buf, sizeof(head));
+        total = sizeof(head) + (uint64_t)head.cnt * sizeof(param_p) + head.size + sizeof(uint32_t);
+        if (head.magic != UPARAM_EXPORT_MAGIC || total > 0xFFFFFFFF)
+        {
+            rt_kprintf("import data is not a param set\r\n");
+            t->error = 1;
+            return;
+        }
+        if ((buf = (uint8_t *)UPARAM_REALLOC(t->buf, total)) == RT_NULL)
+        {
+            rt_kprintf("import buffer malloc failed, size: %u\r\n", (uint32_t)total);
+            t->error = 1;
+            return;
+        }
+        t->buf = buf;
+        t->cap = total;
+    }
+    t->buf[t->len++] = byte;
+}
+
+/**
+  * @brief  import_line
+  * @note   解码一行十六进制或者base64文本
+  * @retval None
+  */
+static void import_line(param_text_struct *t, const char *str)
+{
+    for (; *str != '\0' && !t->error; str++)
+    {
+        int value;
+
+        if (*str == '=')
+        {
+            continue;
+        }
+        if ((value = text_value(t, *str)) < 0)
+        {
+            rt_kprintf("import data has bad char '%c'\r\n", *str);
+            t->error = 1;
+            return;
+        }
+        t->acc = (t->acc << t->bits) | value;
+        t->acc_bits += t->bits;
+        if (t->acc_bits >= 8)
+        {
+            t->acc_bits -= 8;
+            import_byte(t, (t->acc >> t->acc_bits) & 0xFF);
+        }
+    }
+}
+
+/**
+  * @brief  import_reset
+  * @note   释放导入的暂存区
+  * @retval None
+  */
+static void import_reset(param_text_struct *t)
+{
+    UPARAM_FREE(t->buf);
+    memset(t, 0, sizeof(param_text_struct));
+}
+
+#ifdef UPARAM_USING_STATS
+/* 时钟计数换算成微秒 */
+static uint32_t stats_us(uint64_t clocks)
+{
+    return (uint32_t)(clocks * 1000000 / UPARAM_STATS_CLOCK_HZ);
+}
+
+/**
+  * @brief  print_stats_time
+  * @note   打印一项耗时统计和不为0的直方图桶, 桶按上限的微秒数显示
+  * @retval None
+  */
+static void print_stats_time(const char *name, param_stats_time_struct *t)
+{
+    rt_kprintf("%-7s %-8u %-10u %-10u %u\r\n", name, t->count, stats_us(t->last), stats_us(t->max),
+               t->count ? stats_us(t->total / t->count) : 0);
+    if (t->count == 0)
+    {
+        return;
+    }
+    rt_kprintf("        ");
+    for (int b = 0; b < UPARAM_STATS_BUCKETS; b++)
+    {
+        if (t->hist[b] == 0)
+        {
+            continue;
+        }
+        if (b == UPARAM_STATS_BUCKETS - 1)
+        {
+            rt_kprintf(">%u:%u ", stats_us((1ULL << (b - 1)) - 1), t->hist[b]);
+        }
+        else
+        {
+            rt_kprintf("<=%u:%u ", stats_us((1ULL << b) - 1), t->hist[b]);
+        }
+    }
+    rt_kprintf("\r\n");
+}
+#endif
 
 static void par(uint8_t argc, char **argv)
 {
@@ -589,14 +5925,27 @@ static void par(uint8_t argc, char **argv)
 #define CMD_ERASE_INDEX 3
 #define CMD_FLUSH_INDEX 4
 #define CMD_RELOAD_INDEX 5
+#define CMD_EXPORT_INDEX 6
+#define CMD_IMPORT_INDEX 7
     const char *help_info[] =
         {
-            "par list  [*/index] [offset]     - list all param",
-            "par reset [index]                - reset 'index' param to default",
-            "par set   [index] [offset] data1 ... dataN  - set index data[offset] to param with the format",
+            "par list  [*/index/name] [offset] - list all param",
+            "par reset [index/name]           - reset 'index' param to default",
+            "par set   [index/name] [offset] data1 ... dataN  - set index data[offset] to param with the format",
             "par erase [yes]                  - erase all param and reset to default",
             "par flush                        - save all param to flash",
+#ifdef UPARAM_USING_ASYNC_FLUSH
+            "par flush async                  - request the flush thread to save",
+#endif
             "par reload                       - read all param to ram",
+            "par export [hex/b64] [index/name] - print all param, or the list of the param, as import commands",
+            "par import begin [hex/b64]/data/end - import param printed by export, applied at end",
+#ifdef UPARAM_USING_LOG
+            "par log                          - show log sectors and erase count",
+#endif
+#ifdef UPARAM_USING_STATS
+            "par stats [reset]                - show load/flush/erase/lookup counters and times",
+#endif
         };
 
     if (argc < 2)
@@ -619,24 +5968,23 @@ static void par(uint8_t argc, char **argv)
             {
                 uparam_list();
             }
-            else if (argc == 3)
-            {
-                index = strtoul(argv[2], NULL, 0);
-                param_p *pa = (param_p *)find_param_by_index(index);
-                print_element(pa, index, 0);
-            }
-            else if (argc == 4)
+            else if (argc == 3 || argc == 4)
             {
-                index = strtoul(argv[2], NULL, 0);
-                int offset = strtoul(argv[3], NULL, 0);
-                param_p *pa = (param_p *)find_param_by_index(index);
+                index = param_index_by_arg(argv[2]);
+                int offset = (argc == 4) ? strtoul(argv[3], NULL, 0) : 0;
+                if (index >= param_header.cnt.u32)
+                {
+                    rt_kprintf("param is not exist\r\n");
+                    return;
+                }
+                param_list *pa = find_param_by_index(index);
                 print_element(pa, index, offset);
             }
         }
         else if (!strcmp(cmd, "reset"))
         {
-            index = strtoul(argv[2], NULL, 0);
-            if (index > param_header.cnt.u32)
+            index = param_index_by_arg(argv[2]);
+            if (index >= param_header.cnt.u32)
             {
                 rt_kprintf("index is over range\r\n");
                 return;
@@ -644,6 +5992,7 @@ static void par(uint8_t argc, char **argv)
 
             rt_kprintf("reset param , index: %d\r\n", index);
             reset_param_by_index(index);
+            uparam_set_dirty(find_param_by_index(index)->address);
         }
         else if (!strcmp(cmd, "set"))
         {
@@ -656,19 +6005,23 @@ static void par(uint8_t argc, char **argv)
             //设置的数据不是vector的时候offset无效
             param_list *pa_list;
             uint32_t offset;
-            index = strtoul(argv[2], NULL, 0);
+            index = param_index_by_arg(argv[2]);
             offset = strtoul(argv[3], NULL, 0);
 
-            if (index > param_header.cnt.u32)
+            if (index >= param_header.cnt.u32)
             {
                 rt_kprintf("index is over range\r\n");
                 return;
             }
             pa_list = find_param_by_index(index);
+            //先把要修改的一段放在副本里, 最后一次写入参数内存, 大参数只写输入的部分
+            uint32_t value[64];
+            uint32_t commit_off = 0, commit_len = pa_list->size;
             if (pa_list->type[0] == 'f')
             {
                 float value_f = (float)atof(argv[4]);
-                *(float *)(pa_list->address) = value_f;
+                memcpy(value, &value_f, sizeof(float));
+                commit_len = sizeof(float);
                 char buff[32];
                 memset(buff, 0, 32);
                 sprintf(buff, "set index: %d, to value:%.5f \r\n", index, value_f);
@@ -679,10 +6032,10 @@ static void par(uint8_t argc, char **argv)
                 long long value_d = atoll(argv[4]);
 							  unsigned long long value_ud = (long long)1<<63;
 							  value_ud = value_d & ~value_ud;
-                memcpy((uint8_t *)pa_list->address, &value_ud, pa_list->size);
+                memcpy((uint8_t *)value, &value_ud, pa_list->size);
                 if (value_d < 0)
                 {
-                    *((uint8_t *)pa_list->address + pa_list->size - 1) |= 0x80;
+                    *((uint8_t *)value + pa_list->size - 1) |= 0x80;
                 }
 								char buff[32];
                 memset(buff, 0, 32);
@@ -692,7 +6045,7 @@ static void par(uint8_t argc, char **argv)
             else if (pa_list->type[0] == 'u')
             {
                 long long value_u = atoll(argv[4]);
-                memcpy((uint8_t *)pa_list->address, &value_u, pa_list->size);
+                memcpy((uint8_t *)value, &value_u, pa_list->size);
                 char buff[32];
                 memset(buff, 0, 32);
                 sprintf(buff, "set index: %d, to value:%lld \r\n", index, value_u);
@@ -701,18 +6054,21 @@ static void par(uint8_t argc, char **argv)
             else if (pa_list->type[0] == 's')
             {
                 char *value_s = argv[4];
-                if (strlen(value_s) > pa_list->size)
+                if (strlen(value_s) > pa_list->size || strlen(value_s) >= sizeof(value))
                 {
                     rt_kprintf("input value is too long\n");
                     return;
                 }
-                memset(pa_list->address, 0, pa_list->size);
-                memcpy((uint8_t *)pa_list->address, value_s, strlen(value_s));
+                //剩余部分填0, 参数比副本大时只写到结尾的0
+                commit_len = (pa_list->size <= sizeof(value)) ? pa_list->size : strlen(value_s) + 1;
+                memset(value, 0, commit_len);
+                memcpy((uint8_t *)value, value_s, strlen(value_s));
                 rt_kprintf("set index: %d, to value:%s\r\n", index, value_s);
             }
             else if (pa_list->type[0] == 'v')
             {
                 uint8_t input_size = argc - 4;
+                commit_len = 0;
                 int v;
                 //参数是数据的情况下，需要判断offset是否超出地址范围
                 if (pa_list->type[1] == 'b')
@@ -723,11 +6079,13 @@ static void par(uint8_t argc, char **argv)
                         rt_kprintf("offset error,data size: %d\r\n", pa_list->size);
                         return;
                     }
+                    commit_off = offset;
                     rt_kprintf("set index: %d, offset: %d, to value:", index, offset);
-                    for (uint8_t i = 0; i < input_size && i < pa_list->size; i++)
+                    for (uint8_t i = 0; i < input_size && offset + i < pa_list->size && i < sizeof(value); i++)
                     {
                         v = atoi(argv[4 + i]);
-                        *((uint8_t *)pa_list->address + offset + i) = (uint8_t)(v & 0xff);
+                        *((uint8_t *)value + i) = (uint8_t)(v & 0xff);
+                        commit_len = i + 1;
                         rt_kprintf("%d ", (uint8_t)v);
                     }
                 }
@@ -739,11 +6097,13 @@ static void par(uint8_t argc, char **argv)
                         rt_kprintf("offset error,data size: %d\r\n", pa_list->size);
                         return;
                     }
+                    commit_off = offset * 2;
                     rt_kprintf("set index: %d, offset: %d, to value:", index, offset);
-                    for (uint8_t i = 0; i < input_size && i < (pa_list->size / 2); i++)
+                    for (uint8_t i = 0; i < input_size && offset + i < (pa_list->size / 2) && i < sizeof(value) / 2; i++)
                     {
                         v = atoi(argv[4 + i]);
-                        *((uint16_t *)pa_list->address + offset + i) = (uint16_t)(v & 0xffff);
+                        *((uint16_t *)value + i) = (uint16_t)(v & 0xffff);
+                        commit_len = (i + 1) * 2;
                         rt_kprintf("%d ", (uint16_t)v);
                     }
                 }
@@ -755,11 +6115,13 @@ static void par(uint8_t argc, char **argv)
                         rt_kprintf("offset error,data size: %d\r\n", pa_list->size);
                         return;
                     }
+                    commit_off = offset * 4;
                     rt_kprintf("set index: %d, offset: %d, to value:", index, offset);
-                    for (uint8_t i = 0; i < input_size && i < (pa_list->size / 4); i++)
+                    for (uint8_t i = 0; i < input_size && offset + i < (pa_list->size / 4) && i < sizeof(value) / 4; i++)
                     {
                         v = atoi(argv[4 + i]);
-                        *((uint32_t *)pa_list->address + offset + i) = (uint32_t)v;
+                        *((uint32_t *)value + i) = (uint32_t)v;
+                        commit_len = (i + 1) * 4;
                         rt_kprintf("%d ", (uint32_t)v);
                     }
                 }
@@ -771,20 +6133,23 @@ static void par(uint8_t argc, char **argv)
                         rt_kprintf("offset error,data size: %d\r\n", pa_list->size);
                         return;
                     }
+                    commit_off = offset * 4;
                     rt_kprintf("set index: %d, offset: %d, to value:", index, offset);
 
                     char sbuff[128] = {0};
                     char slen = 0;
-                    for (uint8_t i = 0; i < input_size && i < (pa_list->size / 4); i++)
+                    for (uint8_t i = 0; i < input_size && offset + i < (pa_list->size / 4) && i < sizeof(value) / 4; i++)
                     {
                         double dv = atof(argv[4 + i]);
-                        *((float *)pa_list->address + offset + i) = (float)dv;
+                        *((float *)value + i) = (float)dv;
+                        commit_len = (i + 1) * 4;
                         slen += sprintf(sbuff + slen, "%.3f ", (float)dv);
                     }
                     rt_kprintf("%s", sbuff);
                 }
                 rt_kprintf("\r\n");
             }
+            param_commit(pa_list, commit_off, value, commit_len);
         }
         else if (!strcmp(cmd, "erase"))
         {
@@ -805,15 +6170,139 @@ static void par(uint8_t argc, char **argv)
         }
         else if (!strcmp(cmd, "flush"))
         {
-            uparam_flush();
+#ifdef UPARAM_USING_ASYNC_FLUSH
+            if (argc > 2 && !strcmp(argv[2], "async"))
+            {
+                rt_kprintf("flush request %s\r\n", uparam_flush_async() == RT_EOK ? "sent" : "failed");
+                return;
+            }
+#endif
+            uint16_t cnt = uparam_flush();
+            rt_kprintf("flush param: %d, program: %d\r\n", cnt, uparam_flush_prog_count());
         }
         else if (!strcmp(cmd, "reload"))
         {
-            uparam_readall();
+            uparam_reload();
+        }
+        else if (!strcmp(cmd, "export"))
+        {
+            param_text_struct text;
+            const char *format = (argc > 2) ? argv[2] : "hex";
+            param_list *list = RT_NULL;
+            uint16_t li, i;
+
+            if (strcmp(format, "hex") && strcmp(format, "b64"))
+            {
+                rt_kprintf("Usage: %s.\n", help_info[CMD_EXPORT_INDEX]);
+                return;
+            }
+            if (argc > 3)
+            {
+                if (!param_locate(param_index_by_arg(argv[3]), &li, &i))
+                {
+                    rt_kprintf("param is not exist\r\n");
+                    return;
+                }
+                list = ls[li].par_list_add;
+            }
+            memset(&text, 0, sizeof(text));
+            text.bits = strcmp(format, "hex") ? 6 : 4;
+            rt_kprintf("par import begin %s\r\n", format);
+            if (uparam_export(list, export_text, &text) == 0)
+            {
+                rt_kprintf("export failed\r\n");
+                return;
+            }
+            export_text_finish(&text);
+            rt_kprintf("par import end\r\n");
+        }
+        else if (!strcmp(cmd, "import"))
+        {
+            if (argc < 3)
+            {
+                rt_kprintf("Usage: %s.\n", help_info[CMD_IMPORT_INDEX]);
+                return;
+            }
+            if (!strcmp(argv[2], "begin"))
+            {
+                import_reset(&import_text);
+                import_text.bits = (argc > 3 && !strcmp(argv[3], "b64")) ? 6 : 4;
+                import_text.buf = (uint8_t *)UPARAM_MALLOC(sizeof(param_export_struct));
+                import_text.cap = sizeof(param_export_struct);
+                if (import_text.buf == RT_NULL)
+                {
+                    rt_kprintf("import buffer malloc failed\r\n");
+                    import_reset(&import_text);
+                }
+            }
+            else if (import_text.buf == RT_NULL)
+            {
+                rt_kprintf("import is not begin\r\n");
+            }
+            else if (!strcmp(argv[2], "end"))
+            {
+                uint32_t applied = 0;
+
+                if (import_text.error || import_text.len != import_text.cap)
+                {
+                    rt_kprintf("import data is incomplete, %u of %u bytes\r\n", import_text.len, import_text.cap);
+                }
+                else if (uparam_import(import_text.buf, import_text.len, &applied) != RT_EOK)
+                {
+                    rt_kprintf("import data is damaged\r\n");
+                }
+                else
+                {
+                    rt_kprintf("import param: %u, save with 'par flush'\r\n", applied);
+                }
+                import_reset(&import_text);
+            }
+            else
+            {
+                import_line(&import_text, argv[2]);
+            }
+        }
+#ifdef UPARAM_USING_STATS
+        else if (!strcmp(cmd, "stats"))
+        {
+            param_stats_struct st;
+
+            if (argc > 2 && !strcmp(argv[2], "reset"))
+            {
+                uparam_stats_reset();
+                return;
+            }
+            uparam_stats_get(&st);
+            rt_kprintf("Item    Count    Last(us)   Max(us)    Avg(us)\r\n");
+            print_stats_time("init", &st.init);
+            print_stats_time("load", &st.load);
+            print_stats_time("flush", &st.flush);
+            print_stats_time("erase", &st.erase);
+            print_stats_time("lookup", &st.lookup);
+            rt_kprintf("load params: %u, crc errors: %u\r\n", st.load_params, st.crc_errors);
+            rt_kprintf("read: %u calls %u bytes, program: %u calls %u bytes, erase: %u bytes\r\n",
+                       st.read_calls, st.read_bytes, st.prog_calls, st.prog_bytes, st.erase_bytes);
+        }
+#endif
+#ifdef UPARAM_USING_LOG
+        else if (!strcmp(cmd, "log"))
+        {
+            uint32_t seq = 0;
+            const char *state_name[] = {"bad", "spare", "used"};
+
+            rt_kprintf("Sector State Seq         Erase\r\n");
+            for (uint32_t sector = 0; sector < par_log.sector_num; sector++)
+            {
+                uint8_t legacy = 0;
+                int state = log_sector_state(sector, &seq, &legacy);
+                rt_kprintf("%-6d %-5s %-11u %u%s%s\r\n", sector, state_name[state], state == LOG_SECTOR_USED ? seq : 0,
+                           par_log.erase_cnt[sector], legacy == 1 ? " (v1)" : legacy == 2 ? " (v2)" : "", sector == par_log.head ? " <- head" : "");
+            }
         }
+#endif
     }
 }
 
-MSH_CMD_EXPORT(par, uparam operate);
+UPARAM_CMD_EXPORT(par, uparam operate);
 
 #endif
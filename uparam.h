@@ -1,18 +1,141 @@
 #ifndef UPARAM_H
 #define UPARAM_H
 
-#include <rtdevice.h>
-#include <board.h>
+#include "uparam_port.h"
 
-typedef void (*par_default)(void *address, uint8_t size);
+/* 加载时的读缓冲大小, 至少要能放下旧版本最大的一条记录(5+255+1字节), 按目录加载时目录占1/4.
+ * 比缓冲大的参数按缓冲大小分块读取 */
+#ifndef UPARAM_READ_BUF_SIZE
+#define UPARAM_READ_BUF_SIZE 512
+#endif
+
+/* 写入时拼接记录的页缓冲大小, 一般等于flash的编程页大小 */
+#ifndef UPARAM_WRITE_PAGE_SIZE
+#define UPARAM_WRITE_PAGE_SIZE 256
+#endif
+
+/* flash最小写入单位, 每次编程的地址和长度都对齐到它, STM32L4为8, STM32H7为32 */
+#ifndef UPARAM_WRITE_GRAN
+#define UPARAM_WRITE_GRAN 1
+#endif
+
+#if UPARAM_WRITE_PAGE_SIZE % UPARAM_WRITE_GRAN != 0
+#error "UPARAM_WRITE_PAGE_SIZE must be a multiple of UPARAM_WRITE_GRAN"
+#endif
+
+/* 默认保存时和flash里的内容比较找出修改过的参数,
+ * 定义 UPARAM_USING_DIRTY_API_ONLY 后只保存用 uparam_set_dirty 标记过的参数, 保存时不再读flash */
+
+/* 定义 UPARAM_USING_LOG 后使用日志结构保存: 修改的参数追加写到分区里, 加载时最新的记录有效,
+ * 分区写满时才回收最旧的扇区, 擦写均匀分布到整个分区. 每个参数多占用4字节RAM记录最新位置, 每个扇区8字节 */
+
+/* 定义 UPARAM_USING_COMPRESS 后镜像的数据段用RLE压缩后保存, 零和重复的值多时擦写的扇区更少.
+ * 加载时不需要额外的缓冲, 边解压边复制到参数内存. 不管是否定义都能加载压缩和不压缩的镜像. 只用于镜像模式 */
+#if defined(UPARAM_USING_COMPRESS) && defined(UPARAM_USING_LOG)
+#error "UPARAM_USING_COMPRESS can not be used with UPARAM_USING_LOG"
+#endif
+
+/* 定义 UPARAM_USING_ASYNC_FLUSH 后由后台线程保存, uparam_flush_async 只发出请求, 可以在中断里调用 */
+#ifdef UPARAM_USING_ASYNC_FLUSH
+/* 防抖时间, 这段时间内的多次请求合并成一次保存 */
+#ifndef UPARAM_FLUSH_DEBOUNCE_MS
+#define UPARAM_FLUSH_DEBOUNCE_MS 200
+#endif
+/* 请求持续不断时最多推迟这么久也要保存一次 */
+#ifndef UPARAM_FLUSH_MAX_DELAY_MS
+#define UPARAM_FLUSH_MAX_DELAY_MS 2000
+#endif
+#ifndef UPARAM_FLUSH_THREAD_STACK
+#define UPARAM_FLUSH_THREAD_STACK 2048
+#endif
+/* 保存线程优先级, 应低于控制任务 */
+#ifndef UPARAM_FLUSH_THREAD_PRIORITY
+#define UPARAM_FLUSH_THREAD_PRIORITY 25
+#endif
+#endif
+
+/* 定义 UPARAM_USING_LOCK 后支持多线程访问: 读者用 uparam_read_begin/uparam_read_retry 按序号检查,
+ * 不加锁; 写者(uparam_set*、shell、重新加载)用互斥锁排队, 只在复制数据的瞬间关中断并把序号改成奇数.
+ * 保存时先在锁内复制一份数据段快照, 写flash期间不阻塞写者 */
+
+/* 定义 UPARAM_USING_NOTIFY 后可以订阅参数的修改通知. 写入、复位、重新加载和擦除只标记修改过的参数,
+ * 由通知线程合并后调用订阅者的回调, 写入的路径上只多一次置位 */
+#ifdef UPARAM_USING_NOTIFY
+#ifndef UPARAM_NOTIFY_THREAD_STACK
+#define UPARAM_NOTIFY_THREAD_STACK 1024
+#endif
+/* 通知线程优先级, 回调在这个线程里执行 */
+#ifndef UPARAM_NOTIFY_THREAD_PRIORITY
+#define UPARAM_NOTIFY_THREAD_PRIORITY 22
+#endif
+#endif
+
+/* 定义 UPARAM_USING_STATS 后统计加载、保存、擦除和按名称查找的次数和耗时, 用 uparam_stats_get 或
+ * par stats 查看. 耗时按 uparam_stats_clock() 计时, 默认是系统tick, 可以换成周期计数器 */
+#ifdef UPARAM_USING_STATS
+/* 耗时直方图的桶数, 第n个桶是二进制位数为n的耗时, 最后一个桶包括更长的 */
+#ifndef UPARAM_STATS_BUCKETS
+#define UPARAM_STATS_BUCKETS 16
+#endif
+#endif
+
+#ifdef UPARAM_USING_LOCK
+/* 关中断复制一个参数时使用的临时缓冲, 加载时先把整个参数读到这里, 默认值回调也在这里执行,
+ * 比它大的参数临时从堆分配 */
+#ifndef UPARAM_COPY_BUF_SIZE
+#define UPARAM_COPY_BUF_SIZE 64
+#endif
+/* 复位时关中断一次最多复制的默认值长度, 只合并不超过它的连续参数, 一个参数不会被拆开 */
+#ifndef UPARAM_DEFAULT_RUN_MAX
+#define UPARAM_DEFAULT_RUN_MAX 256
+#endif
+#endif
+
+/* 定义 UPARAM_USING_SECTION 后参数表用 UPARAM_LIST_EXPORT 放到链接段里, 参数表、标记位和日志位置
+ * 都是静态分配的, 启动时只遍历链接段, 不使用堆. 这时不能再调用 uparam_add_list */
+
+/* 头部后面预留的镜像CRC槽个数. 只重写了头部以外的扇区时, 新的镜像CRC写到下一个空槽里,
+ * 不用擦除头部所在的扇区; 槽用完后才重写头部 */
+#ifndef UPARAM_CRC_SLOTS
+#define UPARAM_CRC_SLOTS 8
+#endif
+
+/* 在原位置再编程时最多记录的区间数, 分区允许再编程时使用. 只把1写成0的修改记录成区间, 不擦除扇区,
+ * 区间用完后剩下的修改按扇区擦除重写 */
+#ifndef UPARAM_OVERWRITE_MAX
+#define UPARAM_OVERWRITE_MAX 16
+#endif
+
+/* 存储区的最大个数, 包括默认分区. 每个存储区是一个分区或者分区里的一段, 有自己的头部和CRC,
+ * 可以把修改频繁的参数表和很少修改的参数表分开保存, 保存一组时不会擦写另一组 */
+#ifndef UPARAM_STORE_MAX
+#define UPARAM_STORE_MAX 4
+#endif
+/* 能指定存储区的参数表个数, 没有指定的参数表保存在默认分区 */
+#ifndef UPARAM_STORE_LIST_MAX
+#define UPARAM_STORE_LIST_MAX 16
+#endif
+
+/* CRC-32查表的表个数, 1 为逐字节查表(1KB表), 4 为每次处理4字节(4KB表, 约快3倍) */
+#ifndef UPARAM_CRC32_SLICES
+#define UPARAM_CRC32_SLICES 1
+#endif
+
+#if UPARAM_CRC32_SLICES != 1 && UPARAM_CRC32_SLICES != 4
+#error "UPARAM_CRC32_SLICES must be 1 or 4"
+#endif
+
+#define UPARAM_ALIGN(size, align) (((size) + (align)-1) / (align) * (align))
+
+typedef void (*par_default)(void *address, uint16_t size);
 #pragma pack(1)
 /* 参数表需要定义的数据结构 */
 typedef struct
 {
     /* 地址 */
     void *address;
-    /* 长度 */
-    uint8_t size;
+    /* 长度, 最大65535字节 */
+    uint16_t size;
 
     /* 参数名称 */
     const char *name;
@@ -25,33 +148,323 @@ typedef struct
 
     /* 默认参数回调 */
     par_default default_fun;
+
+    /* 默认值, 长度和参数相同, 一般是const数据. 不为空时复位直接复制, 不再调用default_fun */
+    const void *default_value;
 } param_define_struct;
 
 /* 使用这个来定义参数 */
 typedef const param_define_struct param_list;
 
+/* 目录项和日志记录的头部 */
+typedef struct
+{
+    /* 参数ID(名称和类型的哈希), 版本3及以前是参数地址 */
+    uint32_t id;
+    /* 参数字节长度 */
+    uint16_t size;
+} param_p;
+
+/* 版本2及以前的目录项和记录头部, 长度只有1字节 */
 typedef struct
 {
-    /* 参数地址 */
     uint32_t address;
-    /* 参数字节长度, 250字节够了  */
     uint8_t size;
-} param_p;
+} param_p_v2;
 
+/* 参数表的运行状态, 链接段注册时是只读的, 指向的标记位可写. 不压缩对齐, 链接段里的表项之间没有空隙 */
+#pragma pack()
 typedef struct
 {
     /* 指向参数表的地址 */
-    uint32_t par_list_add;
+    const param_define_struct *par_list_add;
     /* 参数表包含的参数数量 */
     uint16_t par_list_size;
     /* 参数是否有效的读出，使用bit来标记参数 */
     uint8_t *read_valid;
+    /* 参数修改后未保存, 使用bit来标记参数, 和read_valid在同一块内存里 */
+    uint8_t *dirty;
+#if defined(UPARAM_USING_LOCK) && !defined(UPARAM_USING_LOG)
+    /* 正在保存的修改标记, 取快照时从dirty移过来, 保存失败时再并回去 */
+    uint8_t *flushing;
+#endif
+#ifdef UPARAM_USING_NOTIFY
+    /* 修改后还没有通知的参数, 和正在通知的参数 */
+    uint8_t *changed;
+    uint8_t *notifying;
+#endif
+#ifdef UPARAM_USING_LOG
+    /* 日志模式下每个参数最新记录在分区里的位置 */
+    uint32_t *log_loc;
+#endif
 } param_struct;
+#pragma pack(1)
+
+/* 每个参数表的标记位组数: read_valid, dirty, 以及可选的 flushing, changed 和 notifying */
+#if defined(UPARAM_USING_LOCK) && !defined(UPARAM_USING_LOG)
+#define UPARAM_FLUSHING_GROUPS 1
+#else
+#define UPARAM_FLUSHING_GROUPS 0
+#endif
+#ifdef UPARAM_USING_NOTIFY
+#define UPARAM_NOTIFY_GROUPS 2
+#else
+#define UPARAM_NOTIFY_GROUPS 0
+#endif
+#define UPARAM_BIT_GROUPS (2 + UPARAM_FLUSHING_GROUPS + UPARAM_NOTIFY_GROUPS)
+/* 一组标记位的字节数 */
+#define UPARAM_BIT_BYTES(num) (((num) + 7) / 8)
+
+#ifdef UPARAM_USING_SECTION
+#define UPARAM_ARRAY_SIZE(table) (sizeof(table) / sizeof((table)[0]))
+#define UPARAM_SECTION_BITS(table, group) (uparam_bits_##table + UPARAM_BIT_BYTES(UPARAM_ARRAY_SIZE(table)) * (group))
+#if UPARAM_FLUSHING_GROUPS
+#define UPARAM_SECTION_FLUSHING(table) .flushing = UPARAM_SECTION_BITS(table, 2),
+#else
+#define UPARAM_SECTION_FLUSHING(table)
+#endif
+#ifdef UPARAM_USING_NOTIFY
+#define UPARAM_SECTION_NOTIFY(table)                                         \
+    .changed = UPARAM_SECTION_BITS(table, 2 + UPARAM_FLUSHING_GROUPS),      \
+    .notifying = UPARAM_SECTION_BITS(table, 3 + UPARAM_FLUSHING_GROUPS),
+#else
+#define UPARAM_SECTION_NOTIFY(table)
+#endif
+#ifdef UPARAM_USING_LOG
+#define UPARAM_SECTION_LOC_DEFINE(table) static uint32_t uparam_loc_##table[UPARAM_ARRAY_SIZE(table)];
+#define UPARAM_SECTION_LOC(table) .log_loc = uparam_loc_##table,
+#else
+#define UPARAM_SECTION_LOC_DEFINE(table)
+#define UPARAM_SECTION_LOC(table)
+#endif
 
+/* 把参数表注册到链接段, table必须是参数表数组本身, 在文件作用域使用:
+ * param_list params[] = {...};
+ * UPARAM_LIST_EXPORT(params); */
+#define UPARAM_LIST_EXPORT(table)                                                                            \
+    static uint8_t uparam_bits_##table[UPARAM_BIT_BYTES(UPARAM_ARRAY_SIZE(table)) * UPARAM_BIT_GROUPS];     \
+    UPARAM_SECTION_LOC_DEFINE(table)                                                                          \
+    UPARAM_SECTION_ENTRY(param_struct) const param_struct uparam_list_##table = {                             \
+        .par_list_add = table,                                                                                \
+        .par_list_size = UPARAM_ARRAY_SIZE(table),                                                            \
+        .read_valid = UPARAM_SECTION_BITS(table, 0),                                                          \
+        .dirty = UPARAM_SECTION_BITS(table, 1),                                                               \
+        UPARAM_SECTION_FLUSHING(table) UPARAM_SECTION_NOTIFY(table) UPARAM_SECTION_LOC(table)}
+#endif
+
+/* 修改通知回调, 订阅单个参数时pa为修改的参数, 订阅参数表时pa为参数表, 一批修改只调用一次 */
+typedef void (*uparam_notify_fn)(param_list *pa, void *user);
+
+/* 订阅者 */
 typedef struct
 {
-    /* 固定头部0X55 */
+    uparam_notify_fn fn;
+    void *user;
+    /* 参数表和参数的序号, 订阅整个参数表时index为UPARAM_NOTIFY_LIST */
+    uint16_t list;
+    uint16_t index;
+} param_subscriber_struct;
+
+#define UPARAM_NOTIFY_LIST 0xFFFF
+
+/* 地址索引, 按地址升序排列, 加载时用来查找flash记录对应的参数, 每个参数占用8字节 */
+typedef struct
+{
+    /* 参数地址(低32位) */
+    uint32_t address;
+    /* 所在参数表 */
+    uint16_t list;
+    /* 在参数表里的序号 */
+    uint16_t index;
+} param_addr_index_struct;
+
+/* ID索引, 按参数ID升序排列, 加载时用来查找flash记录对应的参数, 每个参数占用8字节 */
+typedef struct
+{
+    /* 参数ID, 有名称时为名称和类型的FNV-1a哈希, 没有名称时为地址 */
+    uint32_t id;
+    /* 所在参数表 */
+    uint16_t list;
+    /* 在参数表里的序号 */
+    uint16_t index;
+} param_id_index_struct;
+
+/* 名称索引, 按名称哈希升序排列, 按名称查找参数时使用, 每个参数占用8字节 */
+typedef struct
+{
+    /* 参数名称的FNV-1a哈希 */
+    uint32_t hash;
+    /* 所在参数表 */
+    uint16_t list;
+    /* 在参数表里的序号 */
+    uint16_t index;
+} param_name_index_struct;
+
+/* 分块读取器, 加载时按缓冲大小成块读flash, 在缓冲里解析记录 */
+typedef struct
+{
+    uparam_part_t part;
+    /* 下一次从flash读取的位置 */
+    uint32_t offset;
+    /* 读取的结束位置 */
+    uint32_t end;
+    uint8_t *buf;
+    uint32_t buf_size;
+    /* 缓冲里已解析到的位置 */
+    uint32_t pos;
+    /* 缓冲里有效数据的长度 */
+    uint32_t len;
+    /* flash读取次数 */
+    uint32_t read_calls;
+    /* 上一个写入参数内存的参数内容有变化 */
+    uint8_t changed;
+} param_reader_struct;
+
+/* 写入器的工作方式 */
+/* 把有标记的扇区里的数据按页拼接后编程 */
+#define UPARAM_WRITER_PROGRAM 0
+/* 和flash里的内容比较, 标记内容不同的扇区 */
+#define UPARAM_WRITER_COMPARE 1
+/* 标记脏参数所在的扇区 */
+#define UPARAM_WRITER_MARK 2
+/* 不比较也不编程, 只计算镜像长度 */
+#define UPARAM_WRITER_SIZE 3
+
+/* 能单独标记的扇区数, 超出的扇区每次都会重写 */
+#define UPARAM_MAX_SECTORS 256
+
+/* 镜像里的一段区间 */
+typedef struct
+{
+    uint32_t offset;
+    uint32_t size;
+} param_range_struct;
+
+/* 镜像写入器, 按扇区标记需要重写的部分, 记录拼接到页缓冲里, 到页边界时编程一次 */
+typedef struct
+{
+    uparam_part_t part;
+    uint8_t mode;
+    /* 当前数据是否属于脏参数 */
+    uint8_t dirty;
+    /* 缓冲对应的flash地址 */
+    uint32_t offset;
+    uint8_t *buf;
+    /* 缓冲里的数据长度 */
+    uint32_t len;
+    /* 镜像结束位置 */
+    uint32_t end;
+    uint32_t sector_size;
+    /* 需要擦除重写的扇区 */
+    uint8_t sector_mask[UPARAM_MAX_SECTORS / 8];
+    /* 分区允许在已编程的位置再编程(只把1写成0) */
+    uint8_t overwrite;
+    /* 不擦除, 在原位置再编程的区间, 按地址顺序, 对齐到最小写入单位 */
+    param_range_struct over[UPARAM_OVERWRITE_MAX];
+    uint16_t over_num;
+    /* 编程时已经处理过的区间 */
+    uint16_t over_pos;
+    /* 比较时只把1写成0的数据范围 */
+    uint32_t diff_start;
+    uint32_t diff_end;
+    /* flash编程次数 */
+    uint32_t prog_calls;
+    /* 生成的镜像长度 */
+    uint32_t size;
+} param_writer_struct;
+
+/* RLE控制字节: 0x00~0x7F 后面跟 n+1 个原样的字节, 0x80~0xFF 后面的一个字节重复 (n & 0x7F) + 3 次 */
+#define UPARAM_RLE_LITERAL_MAX 128
+#define UPARAM_RLE_RUN_MIN 3
+#define UPARAM_RLE_RUN_MAX 130
+
+/* RLE编码器, 输出交给镜像写入器 */
+typedef struct
+{
+    /* 还没输出的原样字节 */
+    uint8_t literal[UPARAM_RLE_LITERAL_MAX];
+    uint8_t literal_len;
+    /* 正在统计的重复字节和次数 */
+    uint8_t value;
+    uint8_t run;
+    /* 下一个输出字节在镜像里的位置 */
+    uint32_t offset;
+} param_rle_encoder_struct;
+
+/* RLE解码器, 从读取器里取压缩数据 */
+typedef struct
+{
+    param_reader_struct *r;
+    /* 当前控制字节还剩下的字节数 */
+    uint32_t left;
+    /* 当前是重复段 */
+    uint8_t repeat;
+    uint8_t value;
+} param_rle_decoder_struct;
+
+/* 复位时还没复制的一段默认值, 参数内存和默认值都连续的参数合并成一次复制 */
+typedef struct
+{
+    uint8_t *dst;
+    const uint8_t *src;
+    uint32_t len;
+} param_default_run_struct;
+
+/* 导出时交给输出函数的一段数据 */
+typedef void (*uparam_export_fn)(const uint8_t *data, uint32_t size, void *user);
+
+/* 导出的输出, 同时累加CRC */
+typedef struct
+{
+    uparam_export_fn fn;
+    void *user;
+    uint32_t crc;
+    uint32_t size;
+} param_export_out_struct;
+
+/* shell导入导出的文本编码, 十六进制每个字符4位, base64每个字符6位 */
+#ifndef UPARAM_EXPORT_LINE_CHARS
+#define UPARAM_EXPORT_LINE_CHARS 64
+#endif
+
+typedef struct
+{
+    /* 每个字符的位数, 4 或 6 */
+    uint8_t bits;
+    /* 还没有编码或者解码的位 */
+    uint8_t acc_bits;
+    uint32_t acc;
+    /* 编码时的当前行 */
+    char line[UPARAM_EXPORT_LINE_CHARS + 1];
+    uint8_t line_len;
+    /* 编码时已经输出的字符数 */
+    uint32_t chars;
+    /* 解码时的暂存区 */
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t cap;
+    /* 解码出错, 之后的输入都忽略 */
+    uint8_t error;
+} param_text_struct;
+
+/* 保存格式版本, 加载旧版本的镜像后会按新格式重写
+ * 0: 没有版本号(头部0x55), 记录为 地址+长度+数据+异或校验
+ * 1: 记录同版本0, 校验改为CRC-8, 头部有镜像CRC-32
+ * 2: 目录(地址+长度)和数据分开存放, 数据按地址顺序连续存放, 布局一致时整块读入内存
+ * 3: 同版本2, 目录里的长度改为2字节
+ * 4: 同版本3, 目录里的地址改为参数ID, 重新链接后地址变化也能加载
+ * 版本号的最高位为1时数据段是RLE压缩的 */
+#define UPARAM_FORMAT_VERSION 4
+#define UPARAM_FORMAT_RLE 0x80
+#define UPARAM_HEADER_MAGIC 0xA5
+#define UPARAM_HEADER_MAGIC_V0 0x55
+
+typedef struct
+{
+    /* 固定为 UPARAM_HEADER_MAGIC */
     uint8_t header;
+    /* 保存格式版本 */
+    uint8_t version;
 
     /* 参数个数统计 */
     union {
@@ -65,13 +478,282 @@ typedef struct
         uint8_t u8[4];
     } size;
 
-    /* 头部校验信息 */
-    uint8_t crc;
+    /* 布局指纹, 目录的CRC-32, 和当前参数表的一致时不用读目录 */
+    uint32_t layout;
+
+    /* 头部前面所有字节的CRC-32 */
+    uint32_t crc;
+
+    /* 数据段的CRC-32. 之后的CRC槽里有更新的值时以槽为准 */
+    uint32_t image_crc;
 } param_header_struct;
+
+/* 版本1的头部 */
+typedef struct
+{
+    uint8_t header;
+    uint8_t version;
+    uint32_t cnt;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t image_crc;
+} param_header_v1_struct;
+
+/* 版本0的头部 */
+typedef struct
+{
+    /* 固定头部0X55 */
+    uint8_t header;
+    union {
+        uint32_t u32;
+        uint8_t u8[4];
+    } cnt;
+    union {
+        uint32_t u32;
+        uint8_t u8[4];
+    } size;
+    /* cnt和size的异或校验 */
+    uint8_t crc;
+} param_header_v0_struct;
+
+/* 日志模式的扇区头部, 擦除后立即写入 */
+typedef struct
+{
+    /* 固定为 UPARAM_LOG_MAGIC */
+    uint32_t magic;
+    /* 扇区擦除次数 */
+    uint32_t erase_cnt;
+    uint8_t crc;
+} param_log_format_struct;
+
+/* 日志模式的扇区序号, 扇区开始使用时写入, 按最小写入单位和格式化信息分开 */
+typedef struct
+{
+    /* 越大越新 */
+    uint32_t seq;
+    uint8_t crc;
+} param_log_seq_struct;
+
+/* 计数器存储区的扇区头部, 扇区开头的快照写完后才写入 */
+typedef struct
+{
+    /* 固定为 UPARAM_COUNTER_MAGIC */
+    uint32_t magic;
+    /* 越大越新 */
+    uint32_t seq;
+    uint8_t crc;
+} param_counter_sector_struct;
+
+/* 计数器记录, 每次增加追加一条新的值, 按最小写入单位对齐 */
+typedef struct
+{
+    /* 参数ID */
+    uint32_t id;
+    /* 参数长度, 4或8 */
+    uint8_t size;
+    uint64_t value;
+    uint8_t crc;
+} param_counter_rec_struct;
+
+/* 导出的参数集, 后面是cnt条 目录项(param_p)+数据, 最后是前面所有字节的CRC-32 */
+#define UPARAM_EXPORT_MAGIC 0x31585055 /* "UPX1" */
+
+typedef struct
+{
+    /* 固定为 UPARAM_EXPORT_MAGIC */
+    uint32_t magic;
+    /* 参数个数 */
+    uint32_t cnt;
+    /* 所有参数数据的总长度 */
+    uint32_t size;
+} param_export_struct;
 #pragma pack()
 
+/* 存储区, 镜像模式下一组参数表保存在一个分区或者分区里的一段, 加载和保存时各自独立 */
+typedef struct
+{
+    /* 分区名称 */
+    const char *part_name;
+    uparam_part_t part;
+    /* 在分区里的开始位置和长度, 按扇区对齐 */
+    uint32_t offset;
+    uint32_t len;
+    /* 保存用的头部, 参数个数和数据长度只包括这个存储区的参数表 */
+    param_header_struct header;
+    /* flash里的镜像和参数表的布局一致, 只按脏标记保存时使用 */
+    uint8_t match;
+    /* 加载的镜像格式(带压缩标记), 和保存的格式不同时初始化会重写 */
+    uint8_t version;
+    /* flash里当前的镜像CRC和已经使用的CRC槽个数 */
+    uint32_t crc;
+    uint32_t crc_slots;
+    /* 参数表的布局指纹, 和地址索引一起建立 */
+    uint32_t layout;
+    /* 计数器存储区, 不保存镜像, 按扇区轮流追加计数器记录 */
+    uint8_t counter;
+    /* 当前写入的扇区和它的序号 */
+    uint32_t ring_sector;
+    uint32_t ring_seq;
+    /* 下一条记录在扇区里的位置, 为0时还没有可用的扇区 */
+    uint32_t ring_pos;
+} param_store_struct;
+
+#ifdef UPARAM_USING_STATS
+/* 一项操作的耗时统计, 单位是 uparam_stats_clock() 的计数 */
+typedef struct
+{
+    uint32_t count;
+    uint64_t total;
+    uint32_t last;
+    uint32_t max;
+    uint32_t hist[UPARAM_STATS_BUCKETS];
+} param_stats_time_struct;
+
+/* 运行统计, 从启动或者上次清零开始累计 */
+typedef struct
+{
+    /* 初始化, 只有一次 */
+    param_stats_time_struct init;
+    /* 加载所有参数(启动和重新加载) */
+    param_stats_time_struct load;
+    /* 保存所有参数, last是上一次保存阻塞的时间 */
+    param_stats_time_struct flush;
+    /* flash擦除调用 */
+    param_stats_time_struct erase;
+    /* 按名称查找 */
+    param_stats_time_struct lookup;
+    /* 上一次加载读出的参数个数 */
+    uint32_t load_params;
+    /* 加载时校验失败或者损坏的记录 */
+    uint32_t crc_errors;
+    uint32_t read_calls;
+    uint32_t read_bytes;
+    uint32_t prog_calls;
+    uint32_t prog_bytes;
+    uint32_t erase_bytes;
+} param_stats_struct;
+#endif
+
+/* 日志模式的运行状态 */
+typedef struct
+{
+    uint32_t sector_size;
+    uint32_t sector_num;
+    /* 当前写入的扇区, 没有时为 sector_num */
+    uint32_t head;
+    /* 当前扇区里下一条记录的位置 */
+    uint32_t head_off;
+    /* 当前扇区的序号 */
+    uint32_t seq;
+    /* 一次保存里切换扇区的次数, 防止分区写满时死循环 */
+    uint32_t advances;
+    /* 每个扇区的擦除次数 */
+    uint32_t *erase_cnt;
+    /* 加载时读出的扇区序号, 回放第二遍时是扇区里最后一条最新记录的位置, 和erase_cnt在同一块内存里 */
+    uint32_t *sector_seq;
+    /* 加载到了旧格式扇区, 下一次保存时全部重写 */
+    uint8_t legacy;
+} param_log_struct;
+
 /* 添加参数 */
 rt_err_t uparam_add_list(param_list *list_address, uint16_t list_size);
 /* 写入到flash */
 uint16_t uparam_flush(void);
+/* 指定参数表保存的分区和在分区里的位置, len为0时到分区结尾, 要在 uparam_init 前调用 */
+rt_err_t uparam_set_list_store(param_list *list, const char *part, uint32_t offset, uint32_t len);
+/* 只保存参数表所在的存储区 */
+uint16_t uparam_flush_list(param_list *list);
+/* 参数表保存为计数器, 表里只能是4或8字节的'u'类型参数, 要在 uparam_init 前调用 */
+rt_err_t uparam_set_list_counter(param_list *list, const char *part, uint32_t offset, uint32_t len);
+/* 计数器加n并立即保存, 只追加一条记录, 不擦除 */
+rt_err_t uparam_counter_add(void *address, uint32_t n);
+/* 标记参数已修改, 下次保存时写入 */
+rt_err_t uparam_set_dirty(void *address);
+/* 上一次写入flash时的编程次数 */
+uint32_t uparam_flush_prog_count(void);
+/* 重新从flash加载所有参数 */
+uint16_t uparam_reload(void);
+/* 设置加载用的读缓冲, 传入RT_NULL恢复默认 */
+void uparam_set_read_buffer(void *buf, uint32_t size);
+#ifdef UPARAM_USING_LOG
+/* 日志模式的扇区个数 */
+uint32_t uparam_log_sector_num(void);
+/* 日志模式下扇区的擦除次数 */
+uint32_t uparam_log_erase_count(uint32_t sector);
+#endif
+#ifdef UPARAM_USING_ASYNC_FLUSH
+/* 请求后台线程保存, 不阻塞, 可以在中断里调用 */
+rt_err_t uparam_flush_async(void);
+/* 等待调用前发出的保存请求完成, timeout单位ms, 小于0时一直等待, 写入失败返回 -RT_ERROR */
+rt_err_t uparam_flush_wait(int32_t timeout);
+#endif
+#ifdef UPARAM_USING_NOTIFY
+/* 订阅单个参数的修改通知, address为参数地址 */
+rt_err_t uparam_subscribe(void *address, uparam_notify_fn fn, void *user);
+/* 订阅参数表的修改通知, 表里任意参数修改后调用一次 */
+rt_err_t uparam_subscribe_list(param_list *list, uparam_notify_fn fn, void *user);
+/* 取消fn和user相同的所有订阅 */
+void uparam_unsubscribe(uparam_notify_fn fn, void *user);
+/* 立即在当前线程通知所有已修改的参数, 通知线程也调用它 */
+void uparam_notify_dispatch(void);
+#endif
+/* 按名称查找参数, 没有返回RT_NULL */
+param_list *uparam_find(const char *name);
+/* 按名称读写参数, size必须和参数长度一致, 写入后标记为已修改 */
+rt_err_t uparam_get(const char *name, void *value, uint16_t size);
+rt_err_t uparam_set(const char *name, const void *value, uint16_t size);
+/* 按类型读写, 整数为'd'/'u'类型的1/2/4/8字节参数, 写入时检查范围; 浮点为'f'类型的float/double; 字符串为's'类型 */
+rt_err_t uparam_get_int(const char *name, int64_t *value);
+rt_err_t uparam_set_int(const char *name, int64_t value);
+rt_err_t uparam_get_float(const char *name, double *value);
+rt_err_t uparam_set_float(const char *name, double value);
+rt_err_t uparam_get_str(const char *name, char *buf, uint16_t size);
+rt_err_t uparam_set_str(const char *name, const char *str);
+#ifdef UPARAM_USING_LOCK
+/* 参数内存的修改序号, 奇数表示写者正在修改, 只能通过下面的接口访问 */
+extern volatile uint32_t uparam_seq;
+
+/* 读参数前取序号, 写者正在修改时等待 */
+static inline uint32_t uparam_read_begin(void)
+{
+    uint32_t seq;
+
+    while ((seq = uparam_seq) & 1)
+    {
+    }
+    uparam_rmb();
+    return seq;
+}
+
+/* 读完后检查期间有没有被修改, 返回非0时需要重新读取 */
+static inline int uparam_read_retry(uint32_t seq)
+{
+    uparam_rmb();
+    return uparam_seq != seq;
+}
+
+/* 直接修改参数变量时放在这两个接口中间, 中间会关中断, 只做赋值, 不能在中断里调用 */
+void uparam_write_begin(void);
+void uparam_write_end(void);
+#else
+#define uparam_read_begin() 0
+#define uparam_read_retry(seq) ((void)(seq), 0)
+#define uparam_write_begin()
+#define uparam_write_end()
+#endif
+/* 导出参数集, list为RT_NULL时导出所有参数表, 数据分段交给fn, 返回导出的总字节数, 失败返回0 */
+uint32_t uparam_export(param_list *list, uparam_export_fn fn, void *user);
+/* 导入 uparam_export 导出的参数集, 检查通过后一次写入所有参数并标记为已修改,
+ * 当前没有的参数跳过, applied返回写入的参数个数, 可以为RT_NULL */
+rt_err_t uparam_import(const void *blob, uint32_t size, uint32_t *applied);
+#ifdef UPARAM_USING_STATS
+/* 读出运行统计 */
+void uparam_stats_get(param_stats_struct *out);
+/* 清零运行统计 */
+void uparam_stats_reset(void);
+#endif
+/* 计算CRC-32, 可以分段连续计算, 第一段crc传入0 */
+uint32_t uparam_crc32(uint32_t crc, const void *buf, uint32_t size);
+/* 初始化, RT-Thread上自动执行, 其他平台需要在添加完参数表后调用 */
+int uparam_init(void);
 #endif
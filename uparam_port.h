@@ -0,0 +1,149 @@
+#ifndef UPARAM_PORT_H
+#define UPARAM_PORT_H
+
+/*
+ * uparam 移植层
+ * 默认运行在 RT-Thread + FAL 上; 定义 UPARAM_USING_POSIX 时使用 port/ 目录下的
+ * POSIX 实现(文件 mmap 模拟的参数分区), 用于在主机上运行和测量.
+ * 日志接口(LOG_D/LOG_I/LOG_W/LOG_E)由各平台的日志头文件提供, 见 uparam.c
+ */
+
+#ifdef UPARAM_USING_POSIX
+#include "port/uparam_port_posix.h"
+#else
+#include <rtthread.h>
+#include <rtdevice.h>
+#include <board.h>
+#include <fal.h>
+#include <finsh.h>
+#endif
+
+/* 内存分配 */
+#ifndef UPARAM_MALLOC
+#define UPARAM_MALLOC(size) rt_malloc(size)
+#endif
+#ifndef UPARAM_REALLOC
+#define UPARAM_REALLOC(ptr, size) rt_realloc(ptr, size)
+#endif
+#ifndef UPARAM_FREE
+#define UPARAM_FREE(ptr) rt_free(ptr)
+#endif
+
+/* 自动初始化和shell命令导出 */
+#ifndef UPARAM_INIT_EXPORT
+#define UPARAM_INIT_EXPORT(fn) INIT_COMPONENT_EXPORT(fn)
+#endif
+#ifndef UPARAM_CMD_EXPORT
+#define UPARAM_CMD_EXPORT(cmd, desc) MSH_CMD_EXPORT(cmd, desc)
+#endif
+
+/* 参数分区 */
+#ifndef UPARAM_USING_POSIX
+typedef const struct fal_partition *uparam_part_t;
+
+#define uparam_part_find(name) fal_partition_find(name)
+#define uparam_part_read(part, addr, buf, size) fal_partition_read(part, addr, buf, size)
+#define uparam_part_write(part, addr, buf, size) fal_partition_write(part, addr, buf, size)
+#define uparam_part_erase(part, addr, size) fal_partition_erase(part, addr, size)
+#endif
+
+#ifndef UPARAM_USING_POSIX
+/* 擦除扇区大小, 找不到分区所在的flash设备时返回0 */
+static inline uint32_t uparam_part_sector_size(uparam_part_t part)
+{
+    const struct fal_flash_dev *flash = fal_flash_device_find(part->flash_name);
+
+    return (flash != RT_NULL) ? flash->blk_size : 0;
+}
+#endif
+
+#ifndef UPARAM_USING_POSIX
+/* 线程和同步, 异步保存时使用, ISR里只会调用 uparam_irq_lock/unlock 和 uparam_sem_release */
+typedef rt_sem_t uparam_sem_t;
+typedef rt_mutex_t uparam_mutex_t;
+
+#define uparam_sem_create(name) rt_sem_create(name, 0, RT_IPC_FLAG_FIFO)
+/* ms小于0时一直等待 */
+#define uparam_sem_take(sem, ms) rt_sem_take(sem, (ms) < 0 ? RT_WAITING_FOREVER : rt_tick_from_millisecond(ms))
+#define uparam_sem_release(sem) rt_sem_release(sem)
+#define uparam_mutex_create(name) rt_mutex_create(name, RT_IPC_FLAG_PRIO)
+#define uparam_mutex_lock(mutex) rt_mutex_take(mutex, RT_WAITING_FOREVER)
+#define uparam_mutex_unlock(mutex) rt_mutex_release(mutex)
+#define uparam_irq_lock() rt_hw_interrupt_disable()
+#define uparam_irq_unlock(level) rt_hw_interrupt_enable(level)
+#define uparam_delay_ms(ms) rt_thread_mdelay(ms)
+
+static inline rt_err_t uparam_thread_start(const char *name, void (*entry)(void *param), void *param,
+                                           uint32_t stack_size, uint8_t priority)
+{
+    rt_thread_t tid = rt_thread_create(name, entry, param, stack_size, priority, 10);
+
+    if (tid == RT_NULL)
+    {
+        return -RT_ERROR;
+    }
+    return rt_thread_startup(tid);
+}
+#endif
+
+/* 内存屏障, 多线程访问参数时使用. 读屏障保证前面的读先完成, 写屏障保证前面的写先完成,
+ * 单核MCU上也能阻止编译器重排 */
+#ifndef uparam_rmb
+#if defined(__GNUC__) || defined(__clang__)
+#define uparam_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define uparam_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define uparam_rmb() __DMB()
+#define uparam_wmb() __DMB()
+#endif
+#endif
+
+/* 分区能否在已经编程的位置再编程, 只把bit从1写成0(NOR flash可以). 可以时保存只清除了bit的参数直接在原位置编程,
+ * 不擦除扇区. 带ECC的内部flash(如STM32L4/H7)不允许, 默认关闭, 打开 UPARAM_PART_OVERWRITE 或者按分区重新定义 */
+#ifndef uparam_part_overwrite
+#ifdef UPARAM_PART_OVERWRITE
+#define uparam_part_overwrite(part) 1
+#else
+#define uparam_part_overwrite(part) 0
+#endif
+#endif
+
+#ifndef uparam_part_len
+#define uparam_part_len(part) ((part)->len)
+#endif
+
+/* 统计耗时的时钟, 定义 UPARAM_USING_STATS 时使用. 默认是系统tick, 可以换成周期计数器(如 DWT->CYCCNT),
+ * 同时把 UPARAM_STATS_CLOCK_HZ 定义为它的频率. 按32位差值计算, 一次耗时不能超过计数器一圈 */
+#ifndef uparam_stats_clock
+#define uparam_stats_clock() rt_tick_get()
+#endif
+#ifndef UPARAM_STATS_CLOCK_HZ
+#define UPARAM_STATS_CLOCK_HZ RT_TICK_PER_SECOND
+#endif
+
+/* 参数表的链接段 UParamTab, 定义 UPARAM_USING_SECTION 时使用.
+ * UPARAM_SECTION_ENTRY 修饰放进链接段的表项, 对齐到表项本身的对齐, 表项之间没有填充;
+ * uparam_section_begin/end 返回链接段的开始和结束地址 */
+#if defined(UPARAM_USING_SECTION) && !defined(UPARAM_SECTION_ENTRY)
+#if defined(__ICCARM__)
+#pragma section = "UParamTab"
+#define UPARAM_SECTION_ENTRY(type) __root _Pragma("location=\"UParamTab\"")
+#define uparam_section_begin() __section_begin("UParamTab")
+#define uparam_section_end() __section_end("UParamTab")
+#elif defined(__CC_ARM) || defined(__CLANG_ARM) || (defined(__ARMCC_VERSION) && __ARMCC_VERSION >= 6000000)
+#define UPARAM_SECTION_ENTRY(type) __attribute__((used, section("UParamTab"), aligned(__alignof__(type))))
+extern const int UParamTab$$Base;
+extern const int UParamTab$$Limit;
+#define uparam_section_begin() ((const void *)&UParamTab$$Base)
+#define uparam_section_end() ((const void *)&UParamTab$$Limit)
+#else
+/* GNU ld 给名字是C标识符的段生成 __start_/__stop_ 符号, 链接脚本里不要把 UParamTab 合并到其他输出段 */
+#define UPARAM_SECTION_ENTRY(type) __attribute__((used, section("UParamTab"), aligned(__alignof__(type))))
+extern const char __start_UParamTab[];
+extern const char __stop_UParamTab[];
+#define uparam_section_begin() ((const void *)__start_UParamTab)
+#define uparam_section_end() ((const void *)__stop_UParamTab)
+#endif
+#endif
+
+#endif